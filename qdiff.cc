@@ -26,9 +26,24 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "tappconfig.h"
 #include "trotfile.h"
 #include "tdiffoutput.h"
+#include "tdiffstats.h"
+#include "tdiffengine.h"
+#include "tfilecmp.h"
+#include "tsketch.h"
+#include "tjobpool.h"
+#include "tdirdiff.h"
+#include "tdiff3.h"
+#include "tiotune.h"
+#include "tcheckpoint.h"
+#include "twatch.h"
+#include "tdiffindex.h"
+#include "tjson.h"
+#include "tprofile.h"
 #include "tminmax.h"
 #include "config.h"
 
@@ -49,17 +64,45 @@
 
 
 const char *option_list[] ={
-   "#usage='Usage: %n [OPTION]... FILE1 FILE2\n'",
+   "#usage='Usage: %n [OPTION]... FILE1 FILE2\n   or: %n --multi [OPTION]... FILE1 FILE2 [FILE3]...\n   or: %n --three-way [OPTION]... BASE FILE2 FILE3\nFiles and block devices (compressed files: their decoded data) of at most 2GB\nare diffed; --quiet and --recursive also check whether larger files differ.\n'",
    "#trailer='\n%n version %v\n *** (C) 1997-1999 by Johannes Overmann\n *** (C) 2008 by Tong Sun\ncomments, bugs and suggestions welcome: %e\n%gpl'",
    "#onlycl", // only command line options
    "name=byte-by-byte,      type=switch, char=b,                                     help=\"compare files byte by byte, like 'cmp'\", headline=diff options:",
+   "name=quiet,             type=switch, char=s, errorstatus=2,                      help='print nothing, only check whether the files differ: exit status is 0 if they are identical, 1 if they differ and 2 on trouble (like cmp -s)'",
+   "name=max-shift,         type=int,          param=NUM,     default=-1, lower=-1,   help='detect insertions and deletions of at most NUM bytes, linear runtime on unrelated data unless -f (0: no limit, default: no limit up to 16MB, else 1/64 of the larger file but at least 16MB, at most what the buffers hold)'",
+   "name=sync-time,         type=double,       param=SEC,     default=0, lower=0,     help='give up the search of one resync after SEC seconds and fall back to a cheaper one: heuristics, block hash anchor, substitution (0: no limit)'",
+   "name=sync-work,         type=int,          param=NUM,     default=0, lower=0,     help='like --sync-time, but after NUM million candidate positions (0: no limit)'",
    "name=no-heuristics,     type=switch, char=f,                                     help='do not use heuristics to speed up large differing blocks, note that the result is always correct but with this option you may find a smaller number of differing bytes'",
    "name=min-match,         type=int,    char=m, param=NUM,     default=20, lower=1, help='allow resynchronisation only after a minimum of NUM bytes match, this is an important parameter: lower values may result in a more detailed analysis or in useless results, higher values give a coarse analysis but resynchronisation is more robust'",
-   "name=large-files,       type=switch, char=O,                                     help=optimize disk access for large files on the same disk (locks 16MB mem)",
+   "name=buffer-memory,     type=int,          param=MB,      default=0, lower=0, upper=4096, help='buffer memory per file in MB, the buffers form a 4-way set associative LRU cache (default: 1/64 of the available memory, at most 64MB, 16MB with -O)'",
+   "name=large-files,       type=switch, char=O,                                     help='use 4 buffers of 4MB per file instead of the automatic choice of --verbose (optimized for large files on the same disk)'",
+   "name=no-decompress,     type=switch,                                             help='compare gzip, xz and zstd compressed files as they are stored, do not decode them'",
+   "name=checkpoint,        type=int,          param=MB,      default=4, lower=1, upper=1024, help='save the decoder state of gzip and zstd files every MB megabytes of decoded data, backward accesses decode from the last checkpoint (xz: every block)'",
+   "name=no-holes,          type=switch,                                             help='read the holes of sparse files like data instead of matching them from the extent map'",
+   "name=fiemap,            type=switch,                                             help='get the extent map with the FIEMAP ioctl instead of SEEK_DATA/SEEK_HOLE, preallocated (unwritten) extents then count as holes too'",
+   "name=no-reflinks,       type=switch,                                             help='read extents shared by both files (reflink copies on btrfs/XFS) instead of matching them from their FIEMAP location'",
+   "name=direct-io,         type=switch,                                             help='read with O_DIRECT into 1MB buffers: no page cache pollution and the data really comes from the device (verification runs)'",
+   "name=drop-cache,        type=switch,                                             help='read through the page cache but drop the pages behind the read position and hint the kernel at the ones ahead'",
+   "name=no-huge-pages,     type=switch,                                             help='do not ask for transparent huge pages for buffers of 2MB or more, mapped files and the resync tables'",
+   "name=multi,             type=switch,                                             help='compare FILE1 against each of FILE2 [FILE3]... in parallel, the buffers of FILE1 are shared, print a summary or write the diffs to --output-dir'",
+   "name=three-way,         type=switch, char=3,                                     help='FILE1 is the common base of FILE2 (A) and FILE3 (B): diff both in parallel and print hunks changed only in A, only in B, identically in both or conflicting; exit status 1 on conflicts'",
+   "name=recursive,         type=switch, char=r, errorstatus=2,                      help='FILE1 and FILE2 are directories: compare all files by relative path and print added, removed and changed files with diff summaries'",
+   "name=jobs,              type=int,    char=j, param=NUM,     default=0, lower=0,  help='run NUM diffs in parallel in --multi and --recursive mode (default is the number of cpus)'",
+   "name=state,             type=string,       param=FILE,                           help='save the position of the diff and the output state to FILE every --state-interval seconds, so that a killed diff can continue with --resume, FILE is removed when the diff is complete'",
+   "name=state-interval,    type=int,          param=SEC,     default=300, lower=1,  help=save the --state FILE every SEC seconds",
+   "name=watch,             type=switch,                                             help='after the diff wait for changes of the files and continue the diff from the last resync point before the first changed or appended byte, printing only the new events, until killed'",
+   "name=watch-interval,    type=int,          param=SEC,     default=2, lower=1,    help=with --watch: check the files every SEC seconds in addition to inotify",
+   "name=resume,            type=switch,                                             help='continue the diff saved in the --state FILE, with the same options and files, appending to the output file of the interrupted run (redirect with >>)'",
+   "name=save-index,        type=string,       param=FILE,                           help='save an index of the diff to FILE, which --index prints again without diffing'",
+   "name=index,             type=string,       param=FILE,                           help='print the diff of FILE1 and FILE2 from the index FILE saved by --save-index, in any output mode'",
+   "name=from,              type=int,          param=OFFSET,  default=0, lower=0,     help='with --index: print only the diff from OFFSET of FILE1 on'",
+   "name=to,                type=int,          param=OFFSET,  default=0, lower=0,     help='with --index: print only the diff up to OFFSET of FILE1 (0: end)'",
    "name=formatted,         type=switch, char=a,                                     help='print formatted ascii text, line by line', headline='output modes:  (override automatic file type determination)'",
    "name=unformatted,       type=switch, char=u,                                     help='print unformatted ascii text, block by block'",
    "name=hex,               type=switch, char=x,                                     help='print hex dump, block by block'",
    "name=vertical,          type=switch, char=t,                                     help=print one byte per line (ignores width)",
+   "name=stats,             type=switch,                                             help='print only statistics: bytes and runs per class, run length histogram and change density'",
+   "name=sketch,            type=switch,                                             help='only estimate the similarity of the files from minhash sketches of all NUM byte substrings (NUM = --min-match), FILE1 and FILE2 may also be sketches saved by --save-sketch'",
    "name=no-color,          type=switch, char=c,                                     help=disable ansi coloring of output, headline=output options:",
    "name=alt-colors,        type=switch, char=C,                                     help='no bold ansi coloring (for SGI terminals and the like)'",
    "name=width,             type=int,    char=w, param=NUM,     default=0,           help=output maximal NUM chars (default is terminal width)",
@@ -82,157 +125,338 @@ const char *option_list[] ={
    "name=range-insertion,   type=switch,                                             help=print insertion as byte range",
    "name=range-substitution,type=switch,                                             help=print substitution as two byte ranges",
    "name=range,             type=switch, char=R,                                     help=print everything as byte range",     
+   "name=context,           type=int,          param=NUM,     default=-1, lower=-1,   help='print only NUM bytes (NUM lines in formatted mode) of each match before and after a change, the rest of it as byte range (-1: all)'",
+   "name=hunk-bytes,        type=int,          param=NUM,     default=0, lower=0,     help='print only the first and the last NUM/2 bytes of longer substitutions, deletions and insertions (0: no limit)'",
+   "name=max-hunks,         type=int,          param=NUM,     default=0, lower=0,     help='stop the diff after NUM changes (0: no limit)'",
+   "name=max-output-bytes,  type=int,          param=NUM,     default=0, lower=0,     help='stop the diff after NUM bytes of output (0: no limit)'",
+   "name=stats-block,       type=int,          param=NUM,     default=1, lower=1, upper=1024, help=print change density per NUM MB with --stats",
+   "name=json,              type=switch,                                             help='print --stats, --sketch, --multi, --recursive, --three-way and --profile report as JSON'",
+   "name=output-dir,        type=string,       param=DIR,                            help='with --multi: write the diff against each FILE to DIR/FILE.qdiff (basename of FILE)'",
+   "name=sketch-size,       type=int,          param=NUM,     default=256, lower=16, help=keep NUM hash values per file in --sketch mode (error ~1/sqrt(NUM))",
+   "name=save-sketch,       type=string,       param=FILE,                           help='with --sketch: compute the sketch of the single file given and save it to FILE'",
    "name=verbose,           type=switch, char=v,                                     help=verbose execution, headline='common options:'",
    "name=progress,          type=switch, char=P, help=show progress during work",
+   "name=profile,           type=switch,                                             help='print buffer, engine and output counters and timers to stderr at exit'",
    "EOL"
 };
 
 
-bool prog = false;
+// sketch mode: estimate similarity without diffing
+int sketchMode(const TAppConfig& ac, int numbuf, int bufsize) {
+   int shingle = ac.getInt("min-match");
+   int k = ac.getInt("sketch-size");
+   tstring save = ac.getString("save-sketch");
+   
+   if(save.len()) {
+      if(ac.numParam()!=1)
+	userError("--save-sketch needs exactly one file, try '--help' for more information.\n");
+      TROTFile f(ac.param(0).data(), numbuf, bufsize);
+      TSketch sk(shingle, k);
+      sk.compute(f, prog);
+      sk.save(save.data());
+      if(ac("verbose")) printf("saved sketch of '%s' to '%s'\n", f.name(), save.data());
+      return 0;
+   }
+   if(ac.numParam()!=2) 
+     userError("need two files to compare, try '--help' for more information.\n");
+   
+   // load saved sketches, compute the others with the same parameters
+   TSketch sk[2];
+   bool loaded[2];
+   int i;
+   for(i=0; i<2; i++) {
+      loaded[i] = TSketch::isSketchFile(ac.param(i).data());
+      if(loaded[i]) sk[i].load(ac.param(i).data());
+   }
+   for(i=0; i<2; i++) {
+      if(loaded[i]) continue;
+      if(loaded[1-i]) sk[i] = TSketch(sk[1-i].shingleLen(), sk[1-i].sketchSize());
+      else            sk[i] = TSketch(shingle, k);
+      TROTFile f(ac.param(i).data(), numbuf, bufsize);
+      sk[i].compute(f, prog);
+   }
+   
+   // report
+   double j = sk[0].jaccard(sk[1]);
+   double err = sqrt(j * (1.0 - j) / tMin(sk[0].sketchSize(), sk[1].sketchSize()));
+   if(ac("json")) {
+      printf("{\n");
+      for(i=0; i<2; i++) {
+	 printf("  \"file%d\": {\"name\": ", i+1);
+	 printJSONString(stdout, ac.param(i).data());
+	 printf(", \"size\": %.0f, \"sketch\": %s, \"distinct_shingles\": %.0f},\n", 
+		sk[i].fileSize(), loaded[i]?"true":"false", sk[i].distinct());
+      }
+      printf("  \"shingle\": %d,\n  \"sketch_size\": %d,\n  \"jaccard\": %.4f,\n  \"stderr\": %.4f\n}\n",
+	     sk[0].shingleLen(), tMin(sk[0].sketchSize(), sk[1].sketchSize()), j, err);
+   } else {
+      for(i=0; i<2; i++) 
+	printf("file%d: %s (%.0f bytes, ~%.0f distinct shingles%s)\n", i+1, ac.param(i).data(),
+	       sk[i].fileSize(), sk[i].distinct(), loaded[i]?", saved sketch":"");
+      printf("estimated similarity (jaccard of %d byte shingles, sketch size %d): %.3f +- %.3f\n",
+	     sk[0].shingleLen(), tMin(sk[0].sketchSize(), sk[1].sketchSize()), j, err);
+   }
+   return 0;
+}
 
 
-int match(TROTFile& f1, int o1, TROTFile& f2, int o2) {
-   int i;
-   int s1 = f1.size();
-   int s2 = f2.size();
-   int i1 = o1;
-   int i2 = o2;
-   int print = 256*1024;
-   int pri;
+// result of one file in --multi mode (in shared memory)
+struct TMultiResult {
+   int size;
+   long long matched;
+   long long changed1;
+   long long changed2;
+   long long runs;
+};
 
-   if(!prog) print = -1;
-   for(i=0, pri=print; (i1<s1) && (i2<s2) && (f1[i1] == f2[i2]); i++, i1++, i2++, pri--)
-     if(pri == 0) {
-	pri = print;
-	fprintf(stderr, "mat(%5dK,%5dK)  \r", i1>>10, i2>>10);
-	fflush(stderr);
-     }
-   return i;
-}
 
+// diff one reference against many files, one job per file
+class TMultiDiff: public TJobPool {
+ public:
+   TMultiDiff(TROTFile& reference, const TAppConfig& appconf, int num_buf, int buf_size):
+   TJobPool(sizeof(TMultiResult)), ref(reference), ac(appconf), 
+   numbuf(num_buf), bufsize(buf_size) {}
+   
+   tstring outputName(int i) const;
 
-int syncronizeOnlySubst(TROTFile& f1, int o1, TROTFile& f2, int o2, 
-			int minmatch) {
-   int s1 = f1.size();
-   int s2 = f2.size();
-   int i1 = o1;
-   int i2 = o2;
-   int mis = -1;
-   int i;
-   int print = 256*1024;
-   int pri;
+ protected:
+   int job(int i, void *result);
+   
+ private:
+   TROTFile& ref;
+   const TAppConfig& ac;
+   int numbuf;
+   int bufsize;
+};
 
-   if(!prog) print = -1;
-   for(i=0, pri=print; (i1<s1) && (i2<s2) && ((i-mis) <= minmatch); i++, i1++, i2++, pri--) {
-      if(f1[i1] != f2[i2]) mis = i;
-      if(pri == 0) {
-	 pri = print;
-	 fprintf(stderr, "syn(%5dK,%5dK)  \r", i1>>10, i2>>10);
-	 fflush(stderr);
-      }
-   }
-   if((i - mis) > minmatch) return mis + 1; // match of len minmatch
-   else return i; // eof
+
+tstring TMultiDiff::outputName(int i) const {
+   tstring name = ac.param(i+1);
+   name.extractFilename();
+   return ac.getString("output-dir") + "/" + name + ".qdiff";
 }
 
 
-// return true if minmatch bytes match at o1/o2 in f1/f2
-static inline bool compare(TROTFile& f1, int o1, TROTFile& f2, int o2, 
-			   int minmatch) {
-   int i1=o1;
-   int i2=o2;
+int TMultiDiff::job(int i, void *result) {
+   TMultiResult *r = (TMultiResult *)result;
+   TROTFile f(ac.param(i+1).data(), numbuf, bufsize);
+   TDiffStats stats(ref.name(), ref.size(), f.name(), f.size(), ac.getInt("stats-block") << 20);
    
-   if((f1.size()-i1) < minmatch) return false;
-   if((f2.size()-i2) < minmatch) return false;
-   for(int i=0; i<minmatch; i++, i1++, i2++)
-     if(f1[i1] != f2[i2]) return false;
-   return true;
+   if(ac.getString("output-dir").len()) {
+      tstring fname = outputName(i);
+      if(freopen(fname.data(), "w", stdout) == 0)
+	userError("can't open '%s' for writing!\n", fname.data());
+      if((ref.size()==0) || (f.size()==0)) {
+	 printf("file '%s' is empty, nothing to compare\n", ref.size()?f.name():ref.name());
+	 diff(ref, f, stats, ac);
+      } else {
+	 TDiffOutput out(ref, f, ac);
+	 TDiffTee tee(out, stats);
+	 diff(ref, f, tee, ac);
+      }
+   } else {
+      diff(ref, f, stats, ac);
+   }
+   r->size = f.size();
+   r->matched = stats.matched();
+   r->changed1 = stats.changed1();
+   r->changed2 = stats.changed2();
+   r->runs = stats.runs();
+   return 0;
 }
 
 
-void syncronize(TROTFile& f1, int o1, TROTFile& f2, int o2, int minmatch,
-		bool heurist, int& out_sub, int& out_ins, int& out_del) {
-   out_ins = 0;
-   out_del = 0;
-   out_sub = 0;
+// multi mode: diff FILE1 against all other files
+int multiMode(const TAppConfig& ac, int numbuf, int bufsize) {
+   int i;
+   int num = ac.numParam() - 1;
+   if(num < 1) 
+     userError("need a reference and at least one file to compare, try '--help' for more information.\n");
    
-   // check for eof:
-   if(o1==f1.size()) {
-      out_ins = f2.size()-o2;
-      return;
+   // the reference is buffered completely (up to 256MB), so it is read 
+   // only once and the buffers are shared by all jobs
+   int refnumbuf = numbuf;
+   struct stat st;
+   if(stat(ac.param(0).data(), &st) == 0) {
+      while((double(refnumbuf) * bufsize < st.st_size) && (refnumbuf * bufsize < 256*1024*1024))
+	refnumbuf *= 2;
    }
-   if(o2==f2.size()) {
-      out_del = f1.size()-o1;
-      return;
+   TROTFile ref(ac.param(0).data(), refnumbuf, bufsize);
+   bool shared = ref.preload();
+   if(ac("verbose")) {
+      if(shared) printf("reference '%s' completely buffered, shared by all jobs\n", ref.name());
+      else       printf("reference '%s' is too large to be buffered completely\n", ref.name());
    }
    
-   // simple diff engine: search for sync
-   int max_i = tMax(f1.size()-o1, f2.size()-o2) - minmatch;
-   int print = 20;
-   if(!prog) print=-1;
-   for(int i=0; i <= max_i; i++, print--) {
-      for(int j=0; j <= i; j++) {
-	 if(compare(f1, o1+i, f2, o2+j, minmatch)) {
-	    if(heurist) {
-	       while((i>0) && (j>0) && (f1[o1+i-1]==f2[o2+j-1])) {
-		  i--;
-		  j--;
-	       }
-	    }
-	    out_sub = j;
-	    out_del = i-j;
-	    return;
-	 }
-	 if(compare(f1, o1+j, f2, o2+i, minmatch)) {
-	    if(heurist) {
-	       while((i>0) && (j>0) && (f1[o1+j-1]==f2[o2+i-1])) {
-		  i--;
-		  j--;
-	       }
-	    }
-	    out_sub = j;
-	    out_ins = i-j;
-	    return;
-	 }
-      }
-      if(heurist) i += i/10;
-      if(print==0) {
-	 print=heurist?10:100;
-	 fprintf(stderr, "syncing byte range%8d (%s)\r", i, heurist?"heuristic":"exhaustive");
-      }
+   // largest files first, so they do not delay the end
+   TMultiDiff md(ref, ac, numbuf, bufsize);
+   tvector<double> sizes(num, 0.0);
+   for(i=0; i<num; i++) {
+      if(stat(ac.param(i+1).data(), &st) == 0) sizes[i] = st.st_size;
+      if(ac.getString("output-dir").len())
+	for(int j=0; j<i; j++) 
+	  if(md.outputName(i) == md.outputName(j))
+	    userError("'%s' and '%s' would be written to the same output file!\n", 
+		      ac.param(j+1).data(), ac.param(i+1).data());
    }
+   int jobs = ac.getInt("jobs");
+   if(jobs == 0) jobs = TJobPool::numCPUs();
+   md.run(num, jobs, TJobPool::largestFirst(sizes));
    
-   // no sync found: 
-   out_sub = tMin(f1.size()-o1, f2.size()-o2);
-   out_del = f1.size() - o1 - out_sub;
-   out_ins = f2.size() - o2 - out_sub;
+   // report
+   bool json = ac("json");
+   int failed = 0;
+   if(json) {
+      printf("{\n  \"reference\": {\"name\": ");
+      printJSONString(stdout, ref.name());
+      printf(", \"size\": %d},\n  \"files\": [\n", ref.size());
+   } else {
+      printf("reference: %s (%d bytes)\n", ref.name(), ref.size());
+      printf("%12s %12s %12s %12s %10s %7s  %s\n", "size", "matched", "changed1", 
+	     "changed2", "runs", "match", "file");
+   }
+   for(i=0; i<num; i++) {
+      const TMultiResult *r = (const TMultiResult *)md.result(i);
+      int status = md.exitStatus(i);
+      double m = tMax(ref.size(), r->size);
+      if(status) failed++;
+      if(json) {
+	 printf("    {\"name\": ");
+	 printJSONString(stdout, ac.param(i+1).data());
+	 if(status) printf(", \"status\": %d}", status);
+	 else printf(", \"status\": 0, \"size\": %d, \"matched\": %lld, \"changed1\": %lld, \"changed2\": %lld, \"runs\": %lld}",
+		     r->size, r->matched, r->changed1, r->changed2, r->runs);
+	 printf("%s\n", (i<num-1)?",":"");
+      } else {
+	 if(status) printf("%12s %12s %12s %12s %10s %7s  %s (exit status %d)\n", "failed", "-", "-", "-", "-", "-", 
+			   ac.param(i+1).data(), status);
+	 else printf("%12d %12lld %12lld %12lld %10lld %6.2f%%  %s\n", r->size, r->matched, 
+		     r->changed1, r->changed2, r->runs, m ? 100.0 * r->matched / m : 100.0, 
+		     ac.param(i+1).data());
+      }
+   }
+   if(json) printf("  ]\n}\n");
+   return failed ? 2 : 0;
 }
 
 
+// diff with checkpoints in the --state file: all option values but
+// --resume and --state-interval, and the files, must match when resuming
+static void checkpointedDiff(TROTFile& f1, TROTFile& f2, TDiffSink& out, 
+			     const TAppConfig& ac) {
+   if(ac.getString("state").len() == 0) {
+      diff(f1, f2, out, ac);
+      return;
+   }
+   tvector<tstring> except;
+   except += "resume";
+   except += "state-interval";
+   tstring args = ac.valuesStr(except);
+   for(size_t i=0; i<ac.numParam(); i++) args += ac.param(i) + "\n";
+   TCheckpoint cp(ac.getString("state").data(), ac.getInt("state-interval"), args, f1, f2, out);
+   if(ac("resume")) cp.resume();
+   diff(f1, f2, out, ac, &cp);
+   fflush(stdout);
+   cp.done();
+}
 
 
-
+// diff of two files: printed from an --index, else diffed, saving the
+// --save-index on the way
+static void diffFiles(TROTFile& f1, TROTFile& f2, TDiffSink& out, 
+		      const TAppConfig& ac) {
+   if(ac.getString("index").len()) {
+      TDiffIndex::replay(ac.getString("index").data(), f1, f2, out, 
+			 ac.getInt("from"), ac.getInt("to"));
+   } else if(ac.getString("save-index").len()) {
+      TDiffIndex index(ac.getString("save-index").data(), f1, f2);
+      TDiffTee tee(out, index, true);
+      checkpointedDiff(f1, f2, tee, ac);
+   } else checkpointedDiff(f1, f2, out, ac);
+}
 
 
 // main
 int main(int argc, char *argv[]) {   
-   // init command line options
+   // init command line options; errorstatus=2 of -s and -r: their exit
+   // status 1 means 'files differ', so usage errors exit with 2
    TAppConfig ac(option_list, "option_list", argc, argv, 0, 0, VERSION);
+   prog = ac("progress");
+   TDecompressor::enabled = !ac("no-decompress");
+   TDecompressor::interval = ac.getInt("checkpoint") << 20;
+   TExtentMap::enabled = !ac("no-holes");
+   if(ac("fiemap")) TExtentMap::method = TExtentMap::FIEMAP;
+   TExtentMap::reflinks = !ac("no-reflinks");
+   TROTFile::hugePages = !ac("no-huge-pages");
+   if(ac("direct-io") && ac("drop-cache"))
+     userError("--direct-io and --drop-cache exclude each other.\n");
+   
+   // buffers and backend; --quiet reads each file once from start to end
+   // without buffers, only --direct-io and --drop-cache apply
+   int numbuf = 0;
+   int bufsize = 0;
+   if(ac("quiet") && !(ac("sketch") || ac("multi") || ac("three-way"))) {
+      TROTFile::io = ac("direct-io") ? TROTFile::IO_DIRECT : 
+	ac("drop-cache") ? TROTFile::IO_DROP : TROTFile::IO_CACHED;
+      if(ac("verbose")) fprintf(stderr, "io: %s (--quiet)\n", TROTFile::ioName(TROTFile::io));
+   } else {
+      TIOSetup setup = tuneIO(ac);
+      TROTFile::io = setup.io;
+      TROTFile::readahead = setup.readahead;
+      numbuf = setup.numbuf;
+      bufsize = setup.bufsize;
+      if(ac("verbose")) fprintf(stderr, "%s\n", setup.reason.data());
+   }
+   
+   if(ac.getString("state").len() && (ac("sketch") || ac("multi") || ac("three-way") || 
+				      ac("recursive") || ac("quiet") || ac("profile")))
+     userError("--state needs a diff of two files, not --sketch, --multi, --three-way, --recursive, --quiet or --profile.\n");
+   if(ac("watch") && (ac("sketch") || ac("multi") || ac("three-way") || ac("recursive") || 
+		      ac("quiet") || ac("profile") || ac("stats") || ac.getString("state").len()))
+     userError("--watch needs a diff of two files, not --sketch, --multi, --three-way, --recursive, --quiet, --stats, --profile or --state.\n");
+   bool indexed = ac.getString("index").len() || ac.getString("save-index").len();
+   if(indexed && (ac("sketch") || ac("multi") || ac("three-way") || ac("recursive") || 
+		  ac("quiet") || ac("watch") || ac.getString("state").len()))
+     userError("--index and --save-index need a diff of two files, not --sketch, --multi, --three-way, --recursive, --quiet, --watch or --state.\n");
+   if(ac.getString("index").len() && ac.getString("save-index").len())
+     userError("--index and --save-index exclude each other.\n");
+   if((ac.getInt("from") || ac.getInt("to")) && !ac.getString("index").len())
+     userError("--from and --to need --index.\n");
+   if(ac("resume") && !ac.getString("state").len())
+     userError("--resume needs the --state FILE of the interrupted run.\n");
+   
+   if(ac("sketch")) return sketchMode(ac, numbuf, bufsize);
+   if(ac("multi")) return multiMode(ac, numbuf, bufsize);
+   if(ac("three-way")) {
+      if(ac.numParam()!=3) 
+	userError("need three files (base and two versions), try '--help' for more information.\n");
+      setUserErrorExitStatus(QC_TROUBLE);
+      TDiff3 d3(ac, numbuf, bufsize);
+      return d3.compare();
+   }
+   if(ac.getString("output-dir").len()) 
+     userError("--output-dir needs --multi, try '--help' for more information.\n");
+   if(ac.getString("save-sketch").len()) 
+     userError("--save-sketch needs --sketch, try '--help' for more information.\n");
    if(ac.numParam()!=2) {
       userError("need two files to compare, try '--help' for more information.\n");
    } 
-   prog = ac("progress");
-   
-   // 1MB
-   int numbuf = 16;
-   int bufsize = 64*1024;
+#ifdef QDIFF_NO_PROFILE
+   if(ac("profile")) userError("qdiff was compiled without --profile support (QDIFF_NO_PROFILE)\n");
+#endif
+   if(ac("profile") && (ac("quiet") || ac("recursive")))
+     userError("--profile needs a diff of two files, not --quiet or --recursive.\n");
    
-   if(ac("large-files")) {
-      // 16MB
-      numbuf = 4;
-      bufsize = 4*1024*1024;
+   // directory trees
+   if(ac("recursive")) {
+      TDirDiff dd(ac, numbuf, bufsize);
+      return dd.compare();
    }
    
+   // quiet mode: no diff engine and no output at all
+   if(ac("quiet")) 
+     return quickCompare(ac.param(0).data(), ac.param(1).data());
+   
    // init files
    TROTFile f1(ac.param(0).data(), numbuf, bufsize);
    TROTFile f2(ac.param(1).data(), numbuf, bufsize);
@@ -254,60 +478,29 @@ int main(int argc, char *argv[]) {
    }
    
    // init output
-   TDiffOutput out(f1, f2, ac);
-   
-   // additional config
-   bool bytebybyte = ac("byte-by-byte");
-   bool stoponeof = ac("stop-on-eof");
-   bool heurist = !ac("no-heuristics");
-   int minmatch = ac.getInt("min-match");
-   
-   // do diff
-   int o1=0;
-   int o2=0;
-   int i;
-   int ins, del, sub;
-   while((s1!=o1)&&(s2!=o2)) {
-      if(bytebybyte) {
-	 i = syncronizeOnlySubst(f1, o1, f2, o2, minmatch);
-	 if(i) out.sub(i);
-	 o1 += i;
-	 o2 += i;
-      } else {
-	 syncronize(f1, o1, f2, o2, minmatch, heurist, sub, ins, del);
-	 if(sub) out.sub(sub, ins, del);
-	 else {
-	    if(del) out.del(del);
-	    if(ins) out.ins(ins);
-	 }
-	 o1 += sub + del;
-	 o2 += sub + ins;
+   if(ac("stats")) {
+      TDiffStats stats(f1.name(), s1, f2.name(), s2, ac.getInt("stats-block") << 20);
+      if(ac("profile")) {
+	 TDiffProfile prof(stats, "stats");
+	 diffFiles(f1, f2, prof, ac);
+      } else diffFiles(f1, f2, stats, ac);
+      stats.print(stdout, ac("json"));
+   } else {
+      TDiffOutput out(f1, f2, ac);
+      if(ac("watch")) {
+	 TWatch watch(f1, f2, out, ac);
+	 return watch.run();
       }
-      i = match(f1, o1, f2, o2);
-      if(i) out.mat(i);
-      o1 += i;
-      o2 += i;
+      if(ac("profile")) {
+	 TDiffProfile prof(out, out.modeName());
+	 diffFiles(f1, f2, prof, ac);
+      } else diffFiles(f1, f2, out, ac);
    }
-   if((o1 != s1) && (o2 != s2))
-     fatalError("internal error: (o1!=s1) && (o2!=s2)\n");
-   if(o1 != s1) {
-      if(stoponeof) {
-	 out.flush();
-	 printf("eof in file '%s', %d uncompared bytes follow in file '%s'\n",
-		f2.name(), s1-o1, f1.name());
-      } else out.del(s1-o1);
+   if(ac("profile")) {
+      fflush(stdout);
+      profile.print(stderr, ac("json"), f1, f2);
    }
-   if(o2 != s2) {
-      if(stoponeof) {
-	 out.flush();
-	 printf("eof in file '%s', %d uncompared bytes follow in file '%s'\n",
-		f1.name(), s2-o2, f2.name());
-      } else out.ins(s2-o2);
-   }
-   out.flush();
    
    // end
    return 0;
 }
-
-
@@ -0,0 +1,398 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tappconfig.h"
+#include "tvector.h"
+#include "config.h"
+
+// *** qdiffbench ***
+// generates a deterministic corpus of file pairs and times qdiff on it
+
+
+const char *option_list[] ={
+   "#usage='Usage: %n [OPTION]... QDIFF\n\nrun benchmarks of the qdiff binary QDIFF on a generated corpus\n'",
+   "#trailer='\n%n version %v\n'",
+   "#onlycl", // only command line options
+   "name=corpus,    type=string, char=d, param=DIR,  default=bench-corpus,       help=generate/use corpus in DIR, headline=benchmark options:",
+   "name=size,      type=int,    char=s, param=MB,   default=8, lower=1, upper=1024, help=size of each corpus file in MB",
+   "name=output,    type=string, char=o, param=FILE, default=bench-results.json, help=write results as JSON to FILE",
+   "name=baseline,  type=string, char=b, param=FILE,                            help=compare times to the results in FILE (written by --output)",
+   "name=timeout,   type=int,    char=t, param=SEC,  default=30, lower=1,        help=kill a run after SEC seconds",
+   "name=filter,    type=string, char=f, param=STR,                             help=run only cases whose name contains STR",
+   "name=verbose,   type=switch, char=v,                                        help=verbose execution, headline='common options:'",
+   "EOL"
+};
+
+
+// *** corpus ***
+
+// deterministic pseudo random numbers (xorshift64*)
+class TRandom {
+ public:
+   TRandom(unsigned long long seed): s(seed) {}
+   unsigned long long next() {
+      s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+      return s * 2685821657736338717ULL;
+   }
+   int below(int n) {return int(next() % (unsigned long long)n);}
+ private:
+   unsigned long long s;
+};
+
+
+static tvector<char> randomData(TRandom& r, int n) {
+   tvector<char> d(n);
+   for(int i=0; i<n; i++) d[i] = char(r.next() >> 56);
+   return d;
+}
+
+
+static tvector<char> textData(TRandom& r, int n) {
+   static const char *words[] = {"the", "quick", "brown", "fox", "jumps", "over", 
+      "lazy", "dog", "binary", "diff", "insertion", "deletion", "match", "file",
+      "buffer", "offset", "sync", "engine", "output", "line"};
+   tvector<char> d;
+   d.reserve(n);
+   while(int(d.size()) < n) {
+      int nw = 3 + r.below(10);
+      for(int w=0; w<nw; w++) {
+	 const char *p = words[r.below(20)];
+	 if(w) d.push_back(' ');
+	 while(*p) d.push_back(*(p++));
+      }
+      d.push_back('\n');
+   }
+   d.resize(n);
+   return d;
+}
+
+
+static tvector<char> range(const tvector<char>& d, int from, int to) {
+   tvector<char> r;
+   r.insert(r.end(), d.begin() + from, d.begin() + to);
+   return r;
+}
+
+
+static void writeFile(const tstring& name, const tvector<char>& d) {
+   FILE *f = fopen(name.data(), "wb");
+   if(f == 0) userError("can't open '%s' for writing!\n", name.data());
+   if(d.size() && (fwrite(&d[0], 1, d.size(), f) != d.size())) 
+     userError("error while writing '%s'!\n", name.data());
+   fclose(f);
+}
+
+
+static const char *caseName[] = {"identical", "sparse-subst", "large-insert", 
+   "small-inserts", "block-move", "random", "text"};
+static const int numCases = sizeof(caseName) / sizeof(caseName[0]);
+
+
+// generate pair c of the corpus (file1 and file2) with n bytes each
+static void generateCase(int c, int n, tvector<char>& d1, tvector<char>& d2) {
+   TRandom r(4711 + c);
+   switch(c) {
+    case 0: // identical
+      d1 = d2 = randomData(r, n);
+      break;
+    case 1: // one substituted byte per 64k
+      d1 = d2 = randomData(r, n);
+      for(int i=0; i<n/65536; i++) d2[r.below(n)] ^= 1 + r.below(255);
+      break;
+    case 2: { // n/8 bytes inserted in the middle
+       d1 = randomData(r, n);
+       tvector<char> ins = randomData(r, n/8);
+       d2 = range(d1, 0, n/2);
+       d2 += ins;
+       d2 += range(d1, n/2, n);
+       break;
+    }
+    case 3: { // 1000 insertions of 1-64 bytes
+       d1 = randomData(r, n);
+       d2.clear();
+       int last = 0;
+       for(int i=1; i<=1000; i++) {
+	  int pos = int((double(n) * i) / 1001);
+	  d2 += range(d1, last, pos);
+	  d2 += randomData(r, 1 + r.below(64));
+	  last = pos;
+       }
+       d2 += range(d1, last, n);
+       break;
+    }
+    case 4: { // block of n/16 bytes moved from n/4 to 3n/4
+       d1 = randomData(r, n);
+       int a = n/4, b = n/4 + n/16, c = 3*n/4;
+       d2 = range(d1, 0, a);
+       d2 += range(d1, b, c);
+       d2 += range(d1, a, b);
+       d2 += range(d1, c, n);
+       break;
+    }
+    case 5: // unrelated random data
+      d1 = randomData(r, n);
+      d2 = randomData(r, n);
+      break;
+    case 6: { // text, every 100th line changed
+       d1 = textData(r, n);
+       d2.clear();
+       int line = 0;
+       for(int i=0; i<n; i++) {
+	  d2.push_back(d1[i]);
+	  if(d1[i] == '\n' && ((++line % 100) == 0)) {
+	     const char *edit = "a changed line\n";
+	     while(*edit) d2.push_back(*(edit++));
+	  }
+       }
+       break;
+    }
+   }
+}
+
+
+static tstring caseFile(const tstring& dir, int c, int i) {
+   char buf[32];
+   sprintf(buf, ".%d", i);
+   return dir + "/" + caseName[c] + buf;
+}
+
+
+// generate corpus unless it already exists with the right size
+static void generateCorpus(const tstring& dir, int n, bool verbose) {
+   char buf[32];
+   sprintf(buf, "/.size-%d", n);
+   tstring stamp = dir + buf;
+   if(fexists(stamp.data())) return;
+   mkdir(dir.data(), 0777);
+   for(int c=0; c<numCases; c++) {
+      if(verbose) printf("generating %s\n", caseName[c]);
+      tvector<char> d1, d2;
+      generateCase(c, n, d1, d2);
+      writeFile(caseFile(dir, c, 1), d1);
+      writeFile(caseFile(dir, c, 2), d2);
+   }
+   writeFile(stamp, tvector<char>());
+}
+
+
+// *** runs ***
+
+// qdiff configurations: engines (with --stats, so rendering costs nothing)
+// and output modes (on some cases only, output goes to /dev/null)
+struct TRunConfig {
+   const char *args;
+   const char *cases; // 0 for all
+};
+
+static const TRunConfig runConfig[] = {
+   {"--stats", 0},
+   {"--stats -f", 0},
+   {"--stats -b", 0},
+   {"--stats -m 8", 0},
+   {"--stats -m 64", 0},
+   {"--stats -O", 0},
+   {"--stats -O --no-huge-pages", 0},
+   {"--stats -f --no-huge-pages", 0},
+   {"-s", 0},
+   {"-c -x", "sparse-subst small-inserts"},
+   {"-c -u", "text"},
+   {"-c -a", "text"},
+   {"-c -R", "sparse-subst small-inserts text"},
+   {"-c -t", "sparse-subst"},
+};
+static const int numRunConfigs = sizeof(runConfig) / sizeof(runConfig[0]);
+
+
+struct TRunResult {
+   double seconds;
+   double usertime;
+   double systime;
+   long maxrss;    // kB
+   long syscalls;  // read + write syscalls
+   long hugepages; // transparent huge pages faulted in (system wide), -1 unknown
+   int status;     // exit status, -1 timeout
+};
+
+
+static long procIOSyscalls(pid_t pid) {
+   char fname[64];
+   char line[128];
+   long n = 0, v;
+   sprintf(fname, "/proc/%d/io", int(pid));
+   FILE *f = fopen(fname, "r");
+   if(f == 0) return -1;
+   while(fgets(line, sizeof(line), f)) {
+      if((sscanf(line, "syscr: %ld", &v) == 1) || (sscanf(line, "syscw: %ld", &v) == 1)) n += v;
+   }
+   fclose(f);
+   return n;
+}
+
+
+// thp_fault_alloc of /proc/vmstat, -1 without transparent huge pages
+static long thpFaults() {
+   char line[128];
+   long n = -1;
+   FILE *f = fopen("/proc/vmstat", "r");
+   if(f == 0) return -1;
+   while(fgets(line, sizeof(line), f)) 
+     if(sscanf(line, "thp_fault_alloc %ld", &n) == 1) break;
+   fclose(f);
+   return n;
+}
+
+
+static double now() {
+   struct timeval tv;
+   gettimeofday(&tv, 0);
+   return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+static TRunResult runQdiff(const tstring& qdiff, const tstring& args, 
+			   const tstring& file1, const tstring& file2, int timeout) {
+   TRunResult res;
+   tvector<tstring> a = split(args, " ");
+   tvector<const char *> argv;
+   argv += qdiff.data();
+   for(size_t i=0; i<a.size(); i++) argv += a[i].data();
+   argv += file1.data();
+   argv += file2.data();
+   argv += (const char *)0;
+   
+   fflush(stdout);
+   long thp = thpFaults();
+   double start = now();
+   pid_t pid = fork();
+   if(pid < 0) userError("can't fork!\n");
+   if(pid == 0) {
+      int fd = open("/dev/null", O_WRONLY);
+      dup2(fd, 1);
+      execv(qdiff.data(), (char * const *)&argv[0]);
+      _exit(127);
+   }
+   
+   // wait without reaping, so the io counters can still be read
+   siginfo_t info;
+   bool killed = false;
+   for(;;) {
+      info.si_pid = 0;
+      if(waitid(P_PID, pid, &info, WEXITED|WNOWAIT|WNOHANG) < 0) userError("waitid failed!\n");
+      if(info.si_pid == pid) break;
+      if(!killed && (now() - start > timeout)) {
+	 kill(pid, SIGKILL);
+	 killed = true;
+      }
+      usleep(1000);
+   }
+   res.seconds = now() - start;
+   res.syscalls = procIOSyscalls(pid);
+   res.hugepages = (thp < 0) ? -1 : thpFaults() - thp;
+   
+   int st;
+   struct rusage ru;
+   wait4(pid, &st, 0, &ru);
+   res.usertime = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6;
+   res.systime = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+   res.maxrss = ru.ru_maxrss;
+   if(killed) res.status = -1;
+   else res.status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+   return res;
+}
+
+
+// seconds of case/args in a baseline file, or -1 (one result per line)
+static double baselineSeconds(const tvector<tstring>& baseline, const tstring& key) {
+   for(size_t i=0; i<baseline.size(); i++) {
+      const char *p = strstr(baseline[i].data(), key.data());
+      if(p == 0) continue;
+      p = strstr(p, "\"seconds\": ");
+      if(p) return atof(p + 11);
+   }
+   return -1;
+}
+
+
+int main(int argc, char *argv[]) {
+   TAppConfig ac(option_list, "option_list", argc, argv, 0, 0, VERSION);
+   if(ac.numParam() != 1) 
+     userError("need the qdiff binary to benchmark, try '--help' for more information.\n");
+   tstring qdiff = ac.param(0);
+   tstring dir = ac.getString("corpus");
+   tstring filter = ac.getString("filter");
+   int n = ac.getInt("size") << 20;
+   int timeout = ac.getInt("timeout");
+   bool verbose = ac("verbose");
+   
+   tvector<tstring> baseline;
+   if(ac.getString("baseline").len()) 
+     baseline = loadTextFile(ac.getString("baseline").data());
+   
+   generateCorpus(dir, n, verbose);
+   
+   FILE *out = fopen(ac.getString("output").data(), "w");
+   if(out == 0) userError("can't open '%s' for writing!\n", ac.getString("output").data());
+   fprintf(out, "{\"qdiff\": \"%s\", \"size\": %d, \"results\": [\n", qdiff.data(), n);
+   printf("%-14s %-26s %9s %9s %9s %9s %6s %10s %s\n", "case", "args", "seconds", "MB/s", 
+	  "rss kB", "syscalls", "huge", "status", baseline.size()?"vs baseline":"");
+   bool first = true;
+   for(int c=0; c<numCases; c++) {
+      if(filter.len() && !strstr(caseName[c], filter.data())) continue;
+      tstring f1 = caseFile(dir, c, 1);
+      tstring f2 = caseFile(dir, c, 2);
+      struct stat s1, s2;
+      if(stat(f1.data(), &s1) || stat(f2.data(), &s2)) userError("corpus file missing in '%s'!\n", dir.data());
+      double mb = (double(s1.st_size) + double(s2.st_size)) / (1024.0 * 1024.0);
+      
+      for(int k=0; k<numRunConfigs; k++) {
+	 if(runConfig[k].cases && !strstr(runConfig[k].cases, caseName[c])) continue;
+	 TRunResult r = runQdiff(qdiff, runConfig[k].args, f1, f2, timeout);
+	 tstring key = tstring("\"case\": \"") + caseName[c] + "\", \"args\": \"" + runConfig[k].args + "\"";
+	 
+	 // line per result: the baseline lookup depends on it
+	 fprintf(out, "%s  {%s, \"mb\": %.1f, \"seconds\": %.3f, \"user\": %.3f, \"sys\": %.3f, \"mb_per_s\": %.1f, \"max_rss_kb\": %ld, \"syscalls\": %ld, \"huge_pages\": %ld, \"status\": %d}",
+		 first?"":",\n", key.data(), mb, r.seconds, r.usertime, r.systime, 
+		 r.status < 0 ? 0.0 : mb / r.seconds, r.maxrss, r.syscalls, r.hugepages, r.status);
+	 first = false;
+	 
+	 printf("%-14s %-26s %9.3f %9.1f %9ld %9ld %6ld %10s", caseName[c], runConfig[k].args, 
+		r.seconds, r.status < 0 ? 0.0 : mb / r.seconds, r.maxrss, r.syscalls, r.hugepages,
+		r.status < 0 ? "timeout" : (r.status <= 1 ? "ok" : "error"));
+	 double b = baselineSeconds(baseline, key);
+	 if((b > 0) && (r.status >= 0)) printf(" %6.2fx", b / r.seconds);
+	 printf("\n");
+      }
+   }
+   fprintf(out, "\n]}\n");
+   fclose(out);
+   return 0;
+}
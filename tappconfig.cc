@@ -413,6 +413,7 @@ only_app(false),
 save(false),
 optional_param(false),
 hide(false),
+error_status(0),
 type(TACO_TYPE_NONE),
 set_in(NEVER),
 string_mode(OVERRIDE),
@@ -444,6 +445,7 @@ only_app(false),
 save(false),
 optional_param(false),
 hide(false),
+error_status(0),
 type(TACO_TYPE_NONE),
 set_in(NEVER),
 string_mode(OVERRIDE),
@@ -531,6 +533,9 @@ void TAppConfigItem::validate(const char *line_context) {
    else if(type_str=="string") type=STRING;
    else fatalError2("%s: illegal/unknown type '%s'!\n", line_context, type_str.c_str());
 
+   if(error_status && (type!=SWITCH))
+     fatalError1("%s: errorstatus makes only sense with switches!\n", line_context);
+
    // string mode
    if((string_mode!=OVERRIDE) && (type!=STRING))
      fatalError1("%s: string-mode-... makes only sense with strings!\n", line_context);
@@ -644,6 +649,9 @@ void TAppConfigItem::setComp(const tvector<tstring>& a, bool privat) {
    } else if(comp=="hide") { hide = true;
    } else if(comp=="hidden") { hide = true;
    } else if(comp=="onlycl") { only_cl = true;
+   } else if(comp=="errorstatus") { 
+      if(!param.toInt(error_status)) 
+	fatalError2("%s: illegal errorstatus '%s'!\n", context.c_str(), param.c_str());
    } else if(privat && comp=="onlyapp") { only_app = true;
    } else fatalError2("%s: unknown component '%s'!\n", context.c_str(), comp.c_str());
 }
@@ -892,21 +900,7 @@ void TAppConfigItem::printItemToFile(FILE *f) const {
 }
 
 
-void TAppConfigItem::printCurItemToFile(FILE *f, bool simple) const {
-   if(!simple) {
-      if(!headline.empty()) {    // print headline
-	 fprintf(f, "\n# %.76s\n# %.76s\n\n", headline.c_str(), tstring('=', headline.len()).c_str());
-      }
-      tstring h(help + "\n");
-      if(type==SWITCH) h += "parameter is a switch";
-      else {
-	 h += "parameter is of type " + getTypeStr();
-	 h += " " + getFlagsStr("", false);
-      }
-      while(!h.empty()) {
-	 fprintf(f, "# %s\n", h.getFitWords(80 - 2 - 1).c_str());
-      }
-   }
+tstring TAppConfigItem::getCurItemStr() const {
    tstring val;
    switch(type) {
     case DOUBLE:
@@ -928,14 +922,27 @@ void TAppConfigItem::printCurItemToFile(FILE *f, bool simple) const {
     default:
       break;
    }
-   if(type == SWITCH) {
-      if(bool_value)
-	fprintf(f, "%s\n", name.c_str());
-      else
-	fprintf(f, "#%s\n", name.c_str());
-   } else {
-      fprintf(f, "%s = %s\n", name.c_str(), val.c_str());
-   }     
+   if(type == SWITCH) return (bool_value ? "" : "#") + name;
+   return name + " = " + val;
+}
+
+
+void TAppConfigItem::printCurItemToFile(FILE *f, bool simple) const {
+   if(!simple) {
+      if(!headline.empty()) {    // print headline
+	 fprintf(f, "\n# %.76s\n# %.76s\n\n", headline.c_str(), tstring('=', headline.len()).c_str());
+      }
+      tstring h(help + "\n");
+      if(type==SWITCH) h += "parameter is a switch";
+      else {
+	 h += "parameter is of type " + getTypeStr();
+	 h += " " + getFlagsStr("", false);
+      }
+      while(!h.empty()) {
+	 fprintf(f, "# %s\n", h.getFitWords(80 - 2 - 1).c_str());
+      }
+   }
+   fprintf(f, "%s\n", getCurItemStr().c_str());
    if(!simple) fprintf(f, "\n");
 }
 
@@ -1195,6 +1202,7 @@ commonhead()
    stopatdd = onlycl = verbose_conf = false;
    addConfigItems(conflist, listname, false);
    addConfigItems(self_conflist, "self_conflist", true);
+   doErrorStatus(argc, argv);
    doCommandLine(argc, argv, version);
    for(size_t i=0; i<opt.size(); i++) 
      opt[i].help.searchReplace("%n", getString("application-name"));     
@@ -1751,6 +1759,56 @@ void TAppConfig::doRCFile(const tstring& rcfile, const tstring& clrcfile) {
    }
 }
 
+// index of the option named or uniquely abbreviated by str, -1 if none
+int TAppConfig::findOption(const tstring& str) const {
+   if(alias.contains(str)) return alias[str];
+   if(name.contains(str)) return name[str];
+   int found = -1;
+   for(size_t i = 0; i < opt.size(); i++) {
+      if(opt[i].name.hasPrefix(str) && (!opt[i].only_app)) {
+	 if(found >= 0) return -1;
+	 found = i;
+      }
+   }
+   return found;
+}
+
+// set the exit status of userError() from the switches with an errorstatus
+// before any option is parsed: errors in front of them exit with it too
+void TAppConfig::doErrorStatus(int ac, char *av[]) {
+   const char *validnegnumchars="0123456789.";
+   for(int i=1; i<ac; i++) {
+      if((av[i][0]!='-') || (av[i][1]==0) || 
+	 (ignore_negnum && strchr(validnegnumchars, av[i][1]))) continue;
+      if(av[i][1]=='-') {
+	 if(av[i][2]==0) {
+	    if(stopatdd) return;
+	    continue;
+	 }
+	 char *p = strchr(av[i], '=');
+	 tstring n(&av[i][2]);
+	 if(p) n.truncate(p - &av[i][2]);
+	 int k = n.empty() ? -1 : findOption(n);
+	 if(k < 0) continue;
+	 const TAppConfigItem& a(opt[k]);
+	 if(a.type==TAppConfigItem::SWITCH) {
+	    if(a.error_status) setUserErrorExitStatus(a.error_status);
+	 } else if((!p) && (!a.optional_param)) i++; // skip the parameter
+      } else {
+	 for(const char *p = &av[i][1]; *p; p++) {
+	    int k = char2index[(unsigned char)*p];
+	    if(k < 0) break;
+	    const TAppConfigItem& a(opt[k]);
+	    if(a.type != TAppConfigItem::SWITCH) {
+	       if(p[1]==0) i++; // skip the parameter
+	       break;
+	    }
+	    if(a.error_status) setUserErrorExitStatus(a.error_status);
+	 }
+      }
+   }
+}
+
 void TAppConfig::doCommandLine(int ac, char *av[], const tstring& version) {
    // one of these chars follows a signgle dash '-' to make it a numeric arg
    // in the sense of 'ignore_negnum'
@@ -1878,6 +1936,18 @@ void TAppConfig::printValues() const {
 }
 
 
+tstring TAppConfig::valuesStr(const tvector<tstring>& except) const {
+   tstring r;
+   for(size_t i=0; i<opt.size(); i++) {
+      if(opt[i].only_app) continue;
+      bool skip = false;
+      for(size_t j=0; j<except.size(); j++) if(opt[i].name == except[j]) skip = true;
+      if(!skip) r += opt[i].getCurItemStr() + "\n";
+   }
+   return r;
+}
+
+
 void TAppConfig::setComp(const tvector<tstring>& a, const tstring& context) {
    if((a.size()==1) && (a[0].consistsOfSpace())) return;
    tstring comp = a[0];
@@ -46,6 +46,7 @@ enum TACO_SET_IN {NEVER, DEFAULT, COMMAND_LINE, RC_FILE, ENVIRONMENT, APPLICATIO
    // interface
    void printItemToFile(FILE *f) const; // print default
    void printCurItemToFile(FILE *f, bool simple) const; // print current
+   tstring getCurItemStr() const; // current value as rc file line
    void printValue(const tstring& env, const tstring& rcfile) const;
    void printHelp(int maxoptlen, bool globalonlycl) const;
    int getOptLen() const;
@@ -91,6 +92,7 @@ enum TACO_SET_IN {NEVER, DEFAULT, COMMAND_LINE, RC_FILE, ENVIRONMENT, APPLICATIO
    bool save;
    bool optional_param;
    bool hide;
+   int error_status; // switch: exit status of userError() when set
    
    TACO_TYPE type;
    TACO_SET_IN set_in;
@@ -130,6 +132,8 @@ class TAppConfig {
    // main interface
    void printHelp(bool show_hidden = false) const;
    void printValues() const;
+   // current values of all options but 'except', one 'name = value' per line
+   tstring valuesStr(const tvector<tstring>& except) const;
    bool save(tstring *rc_name_out = 0); // save items with item.save==true
    
    // typed options:
@@ -193,6 +197,8 @@ class TAppConfig {
    void doMetaChar(const tstring& str, const tstring& context);
    void setComp(const tvector<tstring>& a, const tstring& context);
    void addConfigItems(const char **list, const char *listname, bool privat);
+   int findOption(const tstring& str) const;
+   void doErrorStatus(int ac, char *av[]);
    void doCommandLine(int ac, char *av[], const tstring& version);
    void doEnvironVar(const char *envvar);
    void doRCFile(const tstring& rcfile, const tstring& clrcfile);
@@ -0,0 +1,189 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "tcheckpoint.h"
+#include "terror.h"
+#include "tminmax.h"
+
+typedef unsigned long long u64;
+
+static const char stateMagic[8] = {'Q','D','I','F','F','C','P','1'};
+static const int hashSamples = 64;    // samples of the consumed input
+static const int sampleLen   = 64;    // bytes per sample
+static const int tailLen     = 4096;  // bytes hashed before the offset
+
+
+static void putU64(FILE *f, u64 v) {
+   for(int i=0; i<8; i++, v >>= 8) fputc(int(v & 0xff), f);
+}
+
+static bool getU64(FILE *f, u64& v) {
+   v = 0;
+   for(int i=0; i<8; i++) {
+      int c = fgetc(f);
+      if(c == EOF) return false;
+      v |= u64(c) << (8*i);
+   }
+   return true;
+}
+
+static void putStr(FILE *f, const tstring& s) {
+   putU64(f, s.len());
+   fwrite(s.data(), 1, s.len(), f);
+}
+
+static bool getStr(FILE *f, tstring& s) {
+   u64 n;
+   if(!getU64(f, n) || (n > (1 << 30))) return false;
+   tvector<char> b(n + 1);
+   if(fread(&b[0], 1, n, f) != n) return false;
+   s = tstring(&b[0], n);
+   return true;
+}
+
+
+TCheckpoint::TCheckpoint(const char *filename, double seconds, const tstring& arguments,
+			 TROTFile& file1, TROTFile& file2, TDiffSink& sink):
+fname(filename), interval(seconds),
+next(profileClock() + seconds), args(arguments), f1(file1), f2(file2), out(sink)
+{
+   TSinkState st;
+   if(!out.saveState(st))
+     userError("this output can't be checkpointed, --state needs a diff or --stats.\n");
+}
+
+
+// fnv-1a of the size, samples spread over [0..end[ and the bytes before
+// end: cheap for any size, and a file replaced or rewritten is noticed
+u64 TCheckpoint::inputHash(TROTFile& f, int end) {
+   u64 h = 0xcbf29ce484222325ULL;
+   for(int k=0; k<4; k++) h = (h ^ ((u64(f.size()) >> (8*k)) & 0xff)) * 0x100000001b3ULL;
+   for(int k=0; k<hashSamples; k++) {
+      int o = int(double(end) * k / hashSamples);
+      for(int i=o; i < tMin(o + sampleLen, end); i++) h = (h ^ f[i]) * 0x100000001b3ULL;
+   }
+   for(int i=tMax(0, end - tailLen); i<end; i++) h = (h ^ f[i]) * 0x100000001b3ULL;
+   return h;
+}
+
+
+// file format: magic, offsets, output offset (-1: not a file), sizes and
+// hashes of the input, options, sink state (numbers and strings), all
+// numbers 64 bit little endian, strings prefixed with their length;
+// written to FILE.tmp and renamed, so FILE is always complete
+void TCheckpoint::save(int o1, int o2) {
+   TSinkState st;
+   out.saveState(st);
+
+   // the output up to here must be on disk before the state saying so
+   fflush(stdout);
+   long long pos = -1;
+   struct stat a;
+   if((fstat(fileno(stdout), &a) == 0) && S_ISREG(a.st_mode)) {
+      fdatasync(fileno(stdout));
+      pos = lseek(fileno(stdout), 0, SEEK_CUR);
+   }
+
+   tstring tmp = fname + ".tmp";
+   FILE *f = fopen(tmp.data(), "wb");
+   if(f == 0) userError("can't open '%s' for writing!\n", tmp.data());
+   fwrite(stateMagic, 1, sizeof(stateMagic), f);
+   putU64(f, o1);
+   putU64(f, o2);
+   putU64(f, u64(pos));
+   putU64(f, f1.size());
+   putU64(f, f2.size());
+   putU64(f, inputHash(f1, o1));
+   putU64(f, inputHash(f2, o2));
+   putStr(f, args);
+   putU64(f, st.num.size());
+   for(size_t i=0; i<st.num.size(); i++) putU64(f, u64(st.num[i]));
+   putU64(f, st.str.size());
+   for(size_t i=0; i<st.str.size(); i++) putStr(f, st.str[i]);
+   if(fflush(f) || fsync(fileno(f)) || fclose(f))
+     userError("error while writing state file '%s'!\n", tmp.data());
+   if(rename(tmp.data(), fname.data()))
+     userError("can't rename '%s' to '%s'!\n", tmp.data(), fname.data());
+   next = profileClock() + interval;
+}
+
+
+void TCheckpoint::resume() {
+   FILE *f = fopen(fname.data(), "rb");
+   if(f == 0) userError("no checkpoint to resume in '%s'!\n", fname.data());
+   char magic[sizeof(stateMagic)];
+   u64 o1, o2, pos, s1, s2, h1, h2, n, v;
+   tstring a, s;
+   TSinkState st;
+   bool ok = (fread(magic, 1, sizeof(magic), f) == sizeof(magic)) &&
+     (memcmp(magic, stateMagic, sizeof(magic)) == 0) &&
+     getU64(f, o1) && getU64(f, o2) && getU64(f, pos) && getU64(f, s1) &&
+     getU64(f, s2) && getU64(f, h1) && getU64(f, h2) && getStr(f, a) && getU64(f, n);
+   for(u64 i=0; ok && (i<n); i++) {
+      ok = getU64(f, v);
+      st.put((long long)v);
+   }
+   ok = ok && getU64(f, n);
+   for(u64 i=0; ok && (i<n); i++) {
+      ok = getStr(f, s);
+      st.put(s);
+   }
+   fclose(f);
+   if(!ok) userError("'%s' is not a valid state file!\n", fname.data());
+
+   // same run?
+   if(a != args)
+     userError("'%s' was saved by a run with other options or files, resume with the same command line!\n", fname.data());
+   if((s1 != u64(f1.size())) || (s2 != u64(f2.size())) || (o1 > s1) || (o2 > s2) ||
+      (h1 != inputHash(f1, int(o1))) || (h2 != inputHash(f2, int(o2))))
+     userError("the files changed since the checkpoint in '%s' was saved!\n", fname.data());
+   if(!out.loadState(st) || !st.complete())
+     userError("the output state in '%s' does not match this output mode!\n", fname.data());
+   start1 = int(o1);
+   start2 = int(o2);
+
+   // cut the output back to the checkpoint, anything printed so far
+   // (--verbose) is in the output of the first run already
+   fflush(stdout);
+   struct stat st2;
+   bool reg = (fstat(fileno(stdout), &st2) == 0) && S_ISREG(st2.st_mode);
+   long long p = (long long)pos;
+   if(reg && (p >= 0)) {
+      if(st2.st_size < p)
+	userError("the output is shorter than at the checkpoint, resume with '>>' to the output file of the interrupted run!\n");
+      if((st2.st_size > p) && ftruncate(fileno(stdout), p))
+	userError("can't truncate the output to the checkpoint!\n");
+      lseek(fileno(stdout), p, SEEK_SET);
+   } else if(reg || (p >= 0)) {
+      userWarning("the output is not the file of the interrupted run, printing the rest of the diff only\n");
+   }
+   next = profileClock() + interval;
+}
+
+
+void TCheckpoint::done() {
+   unlink(fname.data());
+}
@@ -0,0 +1,65 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tcheckpoint_h_
+#define _tcheckpoint_h_
+
+#include "trotfile.h"
+#include "tdiffsink.h"
+#include "tdiffengine.h"
+#include "tstring.h"
+
+// periodic checkpoints of a diff of two files (see --state and --resume):
+// the engine offsets, the state of the sink, the output offset and a
+// sampled hash of the compared input are written atomically to a state
+// file, so that a killed diff continues where it was saved
+class TCheckpoint: public TDiffPoints {
+ public:
+   // args: the options of the run, a resumed run must use the same ones
+   TCheckpoint(const char *fname, double interval, const tstring& args,
+	       TROTFile& f1, TROTFile& f2, TDiffSink& out);
+
+   // continue at the saved checkpoint: restores the sink, cuts the output
+   // back to where it was saved and sets start1/start2
+   void resume();
+   // save if interval seconds have passed since the last save
+   void point(int o1, int o2) {if(profileClock() >= next) save(o1, o2);}
+   void save(int o1, int o2);
+   // the diff is complete: remove the state file
+   void done();
+   // sampled hash of the first end bytes of f (and of its size)
+   static unsigned long long inputHash(TROTFile& f, int end);
+
+ private:
+   tstring fname;
+   double interval;
+   double next;      // time of the next save
+   tstring args;
+   TROTFile& f1;
+   TROTFile& f2;
+   TDiffSink& out;
+
+   // forbid copy
+   TCheckpoint(const TCheckpoint&);
+   const TCheckpoint& operator=(const TCheckpoint&);
+};
+
+#endif
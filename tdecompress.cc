@@ -0,0 +1,541 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include "tdecompress.h"
+#include "terror.h"
+#include "tminmax.h"
+#include "config.h"
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+#include <zlib.h>
+#define QDIFF_GZIP
+#endif
+#if defined(HAVE_LZMA_H) && defined(HAVE_LIBLZMA)
+#include <lzma.h>
+#define QDIFF_XZ
+#endif
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#include <zstd.h>
+#define QDIFF_ZSTD
+#endif
+
+
+bool TDecompressor::enabled = true;
+int TDecompressor::interval = 4*1024*1024;
+
+static const int inSize = 256*1024;       // compressed bytes read at once
+static const int skipSize = 256*1024;     // decoded bytes skipped at once
+
+
+TDecompressor::TDecompressor(int fd_, const char *filename, const char *format):
+decoded(0), fd(fd_), fname(filename), fmt(format), _size(0), pos(0), tolerant(true)
+{}
+
+
+int TDecompressor::corrupt(const char *what, const char *detail) {
+   char msg[512];
+   if(detail) snprintf(msg, sizeof(msg), "%s data of '%s' is %s (%s)", fmt, fname.data(), what, detail);
+   else snprintf(msg, sizeof(msg), "%s data of '%s' is %s", fmt, fname.data(), what);
+   if(!tolerant) userError("%s!\n", msg);
+   if(err.empty()) err = msg;
+   return -1;
+}
+
+
+void TDecompressor::setSize(long long total) {
+   if(total > 0x7fffffffLL)
+     userError("decompressed size of '%s' exceeds 2GB\n", fname.data());
+   _size = int(total);
+}
+
+
+int TDecompressor::readIn(off_t offset, uchar *buf, int len) {
+   int r = pread(fd, buf, len, offset);
+   if(r < 0) userError("error while reading file '%s'!\n", fname.data());
+   return r;
+}
+
+
+// decode and drop len bytes
+void TDecompressor::skip(int len) {
+   uchar *tmp = new uchar[skipSize];
+   while(len > 0) {
+      int n = decode(tmp, tMin(len, skipSize));
+      if(n <= 0) userError("%s data of '%s' ends early!\n", fmt, fname.data());
+      pos += n;
+      decoded += n;
+      len -= n;
+   }
+   delete[] tmp;
+}
+
+
+void TDecompressor::scan() {
+   uchar *tmp = new uchar[skipSize];
+   long long total = 0;
+   points.clear();
+   mark();
+   points += 0;
+   for(;;) {
+      int n = decode(tmp, skipSize);
+      if(n <= 0) break;
+      total += n;
+      setSize(total);
+      pos = int(total);
+      if((pos - points[points.size()-1] >= interval) && mark()) points += pos;
+   }
+   delete[] tmp;
+   decoded += total;
+   restore(0);
+   pos = 0;
+}
+
+
+void TDecompressor::read(int offset, uchar *buf, int len) {
+   // last checkpoint at or before offset
+   int lo = 0, hi = points.size();
+   while(lo+1 < hi) {
+      int mid = (lo+hi)/2;
+      if(points[mid] <= offset) lo = mid; else hi = mid;
+   }
+   // restart there if it is closer than the current position
+   if((offset < pos) || (points[lo] > pos)) {
+      restore(lo);
+      pos = points[lo];
+   }
+   skip(offset - pos);
+   while(len > 0) {
+      int n = decode(buf, len);
+      if(n <= 0) userError("%s data of '%s' ends early!\n", fmt, fname.data());
+      pos += n;
+      decoded += n;
+      buf += n;
+      len -= n;
+   }
+}
+
+
+int TDecompressor::next(uchar *buf, int len) {
+   int n = decode(buf, len);
+   if(n > 0) {
+      pos += n;
+      decoded += n;
+   }
+   return n;
+}
+
+
+#ifdef QDIFF_GZIP
+// gzip and zlib streams, concatenated members allowed: a checkpoint is a
+// copy of the inflate state and the compressed offset
+class TGzipDecompressor: public TDecompressor {
+ public:
+   TGzipDecompressor(int fd_, const char *filename):
+   TDecompressor(fd_, filename, "gzip"), in(new uchar[inSize]), inpos(0), end(false) {
+      memset(&z, 0, sizeof(z));
+      if(inflateInit2(&z, 15+32) != Z_OK)
+	fatalError("inflateInit2 failed!\n");
+   }
+   virtual ~TGzipDecompressor() {
+      inflateEnd(&z);
+      for(size_t i=0; i<states.size(); i++) {
+	 inflateEnd(states[i]);
+	 delete states[i];
+      }
+      delete[] in;
+   }
+
+ protected:
+   virtual int decode(uchar *out, int len) {
+      z.next_out = out;
+      z.avail_out = len;
+      while(z.avail_out && !end) {
+	 if(z.avail_in == 0) {
+	    int r = readIn(inpos, in, inSize);
+	    if(r == 0) return corrupt("truncated");
+	    inpos += r;
+	    z.next_in = in;
+	    z.avail_in = r;
+	 }
+	 int r = inflate(&z, Z_NO_FLUSH);
+	 if(r == Z_STREAM_END) {
+	    // another member may follow
+	    if(z.avail_in == 0) {
+	       int n = readIn(inpos, in, inSize);
+	       inpos += n;
+	       z.next_in = in;
+	       z.avail_in = n;
+	    }
+	    if(z.avail_in == 0) end = true;
+	    else inflateReset(&z);
+	 } else if((r != Z_OK) && (r != Z_BUF_ERROR))
+	   return corrupt("corrupt", z.msg ? z.msg : "?");
+      }
+      return len - z.avail_out;
+   }
+
+   virtual bool mark() {
+      z_stream *s = new z_stream;
+      if(inflateCopy(s, &z) != Z_OK)
+	userError("out of memory for the checkpoints of '%s'!\n", fname.data());
+      states += s;
+      inoff += off_t(inpos - z.avail_in);
+      return true;
+   }
+
+   virtual void restore(int k) {
+      inflateEnd(&z);
+      if(inflateCopy(&z, states[k]) != Z_OK)
+	userError("out of memory for the checkpoints of '%s'!\n", fname.data());
+      inpos = inoff[k];
+      z.next_in = in;
+      z.avail_in = 0;
+      end = false;
+   }
+
+ private:
+   z_stream z;
+   uchar *in;
+   off_t inpos;              // file offset of the next compressed read
+   bool end;
+   tvector<z_stream *> states;
+   tvector<off_t> inoff;
+};
+#endif
+
+
+#ifdef QDIFF_XZ
+// xz: the stream index lists the blocks, every block is a checkpoint
+// (xz -T or --block-size write several blocks, plain xz only one)
+class TXzDecompressor: public TDecompressor {
+ public:
+   TXzDecompressor(int fd_, const char *filename, off_t filesize):
+   TDecompressor(fd_, filename, "xz"), in(new uchar[inSize]), inpos(0), block(-1), done(true),
+   total(0) {
+      lzma_stream init = LZMA_STREAM_INIT;
+      s = init;
+      // the index is needed for sequential access too
+      if(readIndex(filesize)) restore(0);
+   }
+   virtual ~TXzDecompressor() {
+      lzma_end(&s);
+      delete[] in;
+   }
+
+ protected:
+   virtual int decode(uchar *out, int len) {
+      s.next_out = out;
+      s.avail_out = len;
+      while(s.avail_out) {
+	 if(done) {
+	    if(block+1 >= int(coff.size())) break;
+	    if(!startBlock(block+1)) return -1;
+	 }
+	 if(s.avail_in == 0) {
+	    int r = readIn(inpos, in, inSize);
+	    if(r == 0) return corrupt("truncated");
+	    inpos += r;
+	    s.next_in = in;
+	    s.avail_in = r;
+	 }
+	 lzma_ret r = lzma_code(&s, LZMA_RUN);
+	 if(r == LZMA_STREAM_END) done = true;
+	 else if(r != LZMA_OK) return corrupt("corrupt", lzmaError(r));
+      }
+      return len - s.avail_out;
+   }
+
+   virtual bool mark() {return false;}
+   virtual void index() {setSize(total);}
+
+   virtual void restore(int k) {
+      if(k < int(coff.size())) startBlock(k);
+      else {block = k; done = true;}
+   }
+
+ private:
+   lzma_stream s;
+   uchar *in;
+   off_t inpos;
+   int block;                // current block
+   bool done;                // current block decoded completely
+   lzma_block b;             // used by the decoder until the block end
+   tvector<off_t> coff;      // compressed offset of each block
+   tvector<lzma_vli> unpadded;
+   tvector<lzma_check> check;
+   lzma_vli total;           // decoded size
+
+   static const char *lzmaError(lzma_ret r) {
+      switch(r) {
+       case LZMA_FORMAT_ERROR: return "not xz";
+       case LZMA_OPTIONS_ERROR: return "unsupported options";
+       case LZMA_DATA_ERROR: return "data error";
+       case LZMA_BUF_ERROR: return "truncated";
+       case LZMA_MEM_ERROR: return "out of memory";
+       default: return "error";
+      }
+   }
+
+   bool readIndex(off_t filesize) {
+      lzma_index *index = 0;
+      if(lzma_file_info_decoder(&s, &index, UINT64_MAX, filesize) != LZMA_OK)
+	fatalError("lzma_file_info_decoder failed!\n");
+      for(;;) {
+	 if(s.avail_in == 0) {
+	    int r = readIn(inpos, in, inSize);
+	    inpos += r;
+	    s.next_in = in;
+	    s.avail_in = r;
+	 }
+	 lzma_ret r = lzma_code(&s, LZMA_RUN);
+	 if(r == LZMA_STREAM_END) break;
+	 if(r == LZMA_SEEK_NEEDED) {
+	    inpos = s.seek_pos;
+	    s.avail_in = 0;
+	 } else if(r != LZMA_OK) {
+	    if(index) lzma_index_end(index, 0);
+	    corrupt("corrupt", lzmaError(r));
+	    return false;
+	 }
+      }
+      total = lzma_index_uncompressed_size(index);
+      lzma_index_iter iter;
+      lzma_index_iter_init(&iter, index);
+      while(!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK)) {
+	 points += int(iter.block.uncompressed_file_offset);
+	 coff += off_t(iter.block.compressed_file_offset);
+	 unpadded += iter.block.unpadded_size;
+	 check += iter.stream.flags->check;
+      }
+      if(points.size() == 0) points += 0;
+      lzma_index_end(index, 0);
+      return true;
+   }
+
+   bool startBlock(int k) {
+      uchar hdr[LZMA_BLOCK_HEADER_SIZE_MAX];
+      if(readIn(coff[k], hdr, 1) != 1) {
+	 corrupt("truncated");
+	 return false;
+      }
+      lzma_filter filters[LZMA_FILTERS_MAX + 1];
+      memset(&b, 0, sizeof(b));
+      b.version = 1;
+      b.check = check[k];
+      b.filters = filters;
+      b.header_size = lzma_block_header_size_decode(hdr[0]);
+      const char *bad = 0;
+      if(readIn(coff[k], hdr, b.header_size) != int(b.header_size)) bad = "truncated";
+      else if((lzma_block_header_decode(&b, 0, hdr) != LZMA_OK) ||
+	      (lzma_block_compressed_size(&b, unpadded[k]) != LZMA_OK)) bad = "corrupt";
+      if(bad) {
+	 corrupt(bad);
+	 return false;
+      }
+      lzma_ret r = lzma_block_decoder(&s, &b);
+      for(int i=0; filters[i].id != LZMA_VLI_UNKNOWN; i++) free(filters[i].options);
+      if(r != LZMA_OK) fatalError("lzma_block_decoder failed!\n");
+      inpos = coff[k] + b.header_size;
+      s.avail_in = 0;
+      block = k;
+      done = false;
+      return true;
+   }
+};
+#endif
+
+
+#ifdef QDIFF_ZSTD
+// zstd: a checkpoint is a frame start, so only files of several frames
+// (zstd -B, pzstd, concatenated files) seek without a restart
+class TZstdDecompressor: public TDecompressor {
+ public:
+   TZstdDecompressor(int fd_, const char *filename, off_t size):
+   TDecompressor(fd_, filename, "zstd"), d(ZSTD_createDStream()), inbuf(new uchar[inSize]),
+   inpos(0), frameEnd(true), filesize(size) {
+      if(d == 0) fatalError("ZSTD_createDStream failed!\n");
+      in.src = inbuf;
+      in.size = in.pos = 0;
+   }
+   virtual ~TZstdDecompressor() {
+      ZSTD_freeDStream(d);
+      delete[] inbuf;
+   }
+
+ protected:
+   virtual int decode(uchar *out, int len) {
+      ZSTD_outBuffer o = {out, size_t(len), 0};
+      while(o.pos < o.size) {
+	 if(in.pos == in.size) {
+	    int r = readIn(inpos, inbuf, inSize);
+	    if(r == 0) {
+	       if(!frameEnd) return corrupt("truncated");
+	       break;
+	    }
+	    inpos += r;
+	    in.size = r;
+	    in.pos = 0;
+	 }
+	 size_t r = ZSTD_decompressStream(d, &o, &in);
+	 if(ZSTD_isError(r)) return corrupt("corrupt", ZSTD_getErrorName(r));
+	 frameEnd = (r == 0);
+	 // stop at frame ends, they are the only possible checkpoints
+	 if(frameEnd && o.pos) break;
+      }
+      return int(o.pos);
+   }
+
+   virtual bool mark() {
+      if(!frameEnd) return false;
+      inoff += off_t(inpos - (in.size - in.pos));
+      return true;
+   }
+
+   virtual void restore(int k) {
+      ZSTD_DCtx_reset(d, ZSTD_reset_session_only);
+      inpos = inoff[k];
+      in.size = in.pos = 0;
+      frameEnd = true;
+   }
+
+   // sizes and frame starts from the frame and block headers, nothing is
+   // decoded; frames without content size (zstd writing to a pipe) need
+   // a scan
+   virtual void index() {
+      static const int fcsLen[4] = {0, 2, 4, 8};
+      static const int dictLen[4] = {0, 1, 2, 4};
+      long long total = 0;
+      off_t off = 0;
+      uchar h[18];   // largest frame header
+      points.clear();
+      inoff.clear();
+      while(off < filesize) {
+	 int n = readIn(off, h, sizeof(h));
+	 if(n < 8) {
+	    corrupt("truncated");
+	    return;
+	 }
+	 unsigned magic = h[0] | (h[1] << 8) | (h[2] << 16) | (unsigned(h[3]) << 24);
+	 if((magic & 0xfffffff0) == ZSTD_MAGIC_SKIPPABLE_START) {
+	    off += 8 + off_t(h[4] | (h[5] << 8) | (h[6] << 16) | (unsigned(h[7]) << 24));
+	    continue;
+	 }
+	 unsigned long long fcs = ZSTD_getFrameContentSize(h, n);
+	 if(fcs == ZSTD_CONTENTSIZE_ERROR) {
+	    corrupt("corrupt", "frame header");
+	    return;
+	 }
+	 if(fcs == ZSTD_CONTENTSIZE_UNKNOWN) {
+	    inoff.clear();
+	    scan();
+	    return;
+	 }
+	 if((points.size() == 0) || (total - points[points.size()-1] >= interval)) {
+	    points += int(total);
+	    inoff += off;
+	 }
+	 total += fcs;
+	 setSize(total);
+	 // header: magic, descriptor, window, dictionary id, content size
+	 int single = (h[4] >> 5) & 1;
+	 off += 5 + !single + dictLen[h[4] & 3] + tMax(fcsLen[h[4] >> 6], single);
+	 // blocks: 3 byte header, RLE blocks store a single byte
+	 for(bool last = false; !last; ) {
+	    uchar b[3];
+	    if(readIn(off, b, 3) != 3) {
+	       corrupt("truncated");
+	       return;
+	    }
+	    int bh = b[0] | (b[1] << 8) | (b[2] << 16);
+	    if(((bh >> 1) & 3) == 3) {
+	       corrupt("corrupt", "block header");
+	       return;
+	    }
+	    off += 3 + ((((bh >> 1) & 3) == 1) ? 1 : (bh >> 3));
+	    last = bh & 1;
+	 }
+	 if(h[4] & 4) off += 4;   // content checksum
+      }
+      if(off > filesize) corrupt("truncated");
+      if(points.size() == 0) {
+	 points += 0;
+	 inoff += 0;
+      }
+      restore(0);
+      pos = 0;
+   }
+
+ private:
+   ZSTD_DStream *d;
+   uchar *inbuf;
+   ZSTD_inBuffer in;
+   off_t inpos;
+   bool frameEnd;
+   off_t filesize;
+   tvector<off_t> inoff;
+};
+#endif
+
+
+TDecompressor *TDecompressor::open(int fd, const char *fname, bool seekable) {
+   struct stat st;
+   uchar magic[6];
+   if(!enabled || fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+      (pread(fd, magic, 6, 0) != 6)) return 0;
+   const char *lib = 0;
+   TDecompressor *d = 0;
+   if((magic[0] == 0x1f) && (magic[1] == 0x8b)) {
+#ifdef QDIFF_GZIP
+      d = new TGzipDecompressor(fd, fname);
+#endif
+      lib = "zlib";
+   } else if(memcmp(magic, "\xfd" "7zXZ\0", 6) == 0) {
+#ifdef QDIFF_XZ
+      d = new TXzDecompressor(fd, fname, st.st_size);
+#endif
+      lib = "liblzma";
+   } else if(memcmp(magic, "\x28\xb5\x2f\xfd", 4) == 0) {
+#ifdef QDIFF_ZSTD
+      d = new TZstdDecompressor(fd, fname, st.st_size);
+#endif
+      lib = "libzstd";
+   } else return 0;
+   if(d == 0) {
+      userWarning("'%s' is compressed, but qdiff was built without %s: comparing the compressed bytes\n",
+		  fname, lib);
+      return 0;
+   }
+   
+   // magic bytes by chance (or a damaged file): compare the stored bytes
+   if(seekable && d->err.empty()) d->index();
+   if(d->err.len()) {
+      userWarning("%s: comparing the stored bytes\n", d->error());
+      delete d;
+      return 0;
+   }
+   d->tolerant = !seekable;
+   return d;
+}
@@ -0,0 +1,96 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tdecompress_h_
+#define _tdecompress_h_
+
+#include <sys/types.h>
+#include "ttypes.h"
+#include "tstring.h"
+#include "tvector.h"
+
+// random access to the decoded contents of a gzip, xz or zstd compressed
+// file: data is decoded forward from the last checkpoint before the
+// requested offset, so backward accesses never restart at the beginning
+class TDecompressor {
+ public:
+   virtual ~TDecompressor() {}
+
+   // decompressor for the open file fd if its magic bytes name a supported
+   // format and its data decodes, else 0 (with a warning if it does not);
+   // without seekable only next() may be used and nothing is decoded ahead
+   static TDecompressor *open(int fd, const char *fname, bool seekable = true);
+
+   // access
+   void read(int offset, uchar *buf, int len);
+   // sequential access: the next at most len bytes, 0 at the end, -1 if
+   // the data is corrupt (see error())
+   int next(uchar *buf, int len);
+   const char *error() const {return err.data();}
+   int size() const {return _size;}
+   const char *format() const {return fmt;}
+   int numCheckpoints() const {return points.size();}
+   long long decoded;     // bytes decoded, including skipped ones
+
+   // settings, see --no-decompress and --checkpoint
+   static bool enabled;
+   static int interval;   // decoded bytes between checkpoints
+
+ protected:
+   TDecompressor(int fd, const char *fname, const char *format);
+
+   // decode the next at most len bytes, return 0 at the end of the data
+   // and -1 if it is corrupt
+   virtual int decode(uchar *out, int len) = 0;
+   // save the decoder state at pos as checkpoint, false if not possible here
+   virtual bool mark() = 0;
+   // continue decoding at checkpoint k
+   virtual void restore(int k) = 0;
+
+   // get the size and the checkpoints, by default with scan()
+   virtual void index() {scan();}
+   // decode everything once to get the size and the checkpoints
+   void scan();
+   void setSize(long long total);
+   // corrupt data: fatal once open() has indexed the file, before that
+   // (and for next()) recorded in err and -1 returned
+   int corrupt(const char *what, const char *detail = 0);
+   // read compressed data at offset, return the number of bytes read
+   int readIn(off_t offset, uchar *buf, int len);
+
+   int fd;
+   tstring fname;
+   const char *fmt;
+   int _size;
+   int pos;               // decoded offset of the next decode()
+   tvector<int> points;   // decoded offsets of the checkpoints
+   bool tolerant;         // see corrupt()
+   tstring err;
+
+ private:
+   void skip(int len);
+
+   // forbid copy
+   TDecompressor(const TDecompressor&);
+   const TDecompressor& operator=(const TDecompressor&);
+};
+
+#endif
@@ -0,0 +1,301 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+
+#include <sys/ioctl.h>
+#include <string.h>
+#include "tdiff3.h"
+#include "tdiffengine.h"
+#include "tjson.h"
+#include "tminmax.h"
+
+
+static const char *color_nor = "\033[m";
+static const char *color_one = "\033[00;32m"; // changed in one file
+static const char *color_con = "\033[01;31m"; // conflict
+static const char *color_both= "\033[01;33m"; // changed identically
+static const char *color_mat = "\033[01;37m";
+static const char *color_sep = "\033[00;34m";
+
+
+void TChangeList::add(int blen, int olen) {
+   if(changes.size()) {
+      TChange& last = changes[changes.size()-1];
+      if((last.b + last.blen == b) && (last.o + last.olen == o)) {
+	 last.blen += blen;
+	 last.olen += olen;
+	 b += blen;
+	 o += olen;
+	 return;
+      }
+   }
+   TChange c = {b, blen, o, olen};
+   changes += c;
+   b += blen;
+   o += olen;
+}
+
+
+TDiff3::TDiff3(const TAppConfig& appconf, int numbuf, int bufsize):
+TJobPool(sizeof(int)), ac(appconf), 
+base(appconf.param(0).data(), numbuf, bufsize),
+fa(appconf.param(1).data(), numbuf, bufsize),
+fb(appconf.param(2).data(), numbuf, bufsize)
+{
+   for(int i=0; i<2; i++) {
+      tmp[i] = tmpfile();
+      if(tmp[i] == 0) userError("can't create temporary file!\n");
+   }
+}
+
+
+TDiff3::~TDiff3() {
+   fclose(tmp[0]);
+   fclose(tmp[1]);
+}
+
+
+const char *TDiff3::className(int cls) {
+   switch(cls) {
+    case ONLY_A:   return "only-a";
+    case ONLY_B:   return "only-b";
+    case BOTH:     return "both";
+    case CONFLICT: return "conflict";
+   }
+   return "";
+}
+
+
+// job i: diff base against A (0) or B (1), write the changes to tmp[i]
+int TDiff3::job(int i, void *result) {
+   TChangeList list;
+   diff(base, i ? fb : fa, list, ac);
+   size_t n = list.changes.size();
+   if(n && (fwrite(&list.changes[0], sizeof(TChange), n, tmp[i]) != n)) return 1;
+   if(fflush(tmp[i])) return 1;
+   *(int *)result = n;
+   return 0;
+}
+
+
+// does change c belong to the hunk [lo,hi) of base? touching counts, 
+// so that an insertion at the border of a change conflicts with it
+static bool touches(const TChange& c, int lo, int hi) {
+   return (c.b < hi) || ((c.b == hi) && ((c.blen == 0) || (lo == hi)));
+}
+
+
+bool TDiff3::sameContent(const THunk& h) {
+   if(h.len[1] != h.len[2]) return false;
+   for(int k=0; k<h.len[1]; k++)
+     if(fa[h.start[1]+k] != fb[h.start[2]+k]) return false;
+   return true;
+}
+
+
+// merge the changes of A and B (both sorted by base offset) into hunks
+void TDiff3::merge() {
+   const tvector<TChange>& ca = changes[0];
+   const tvector<TChange>& cb = changes[1];
+   size_t ia = 0, ib = 0;
+   int da = 0, db = 0; // offset in A/B minus offset in base before the hunk
+   while((ia < ca.size()) || (ib < cb.size())) {
+      // the first change starts the hunk, then collect all touching ones
+      bool first_a = (ib >= cb.size()) || ((ia < ca.size()) && (ca[ia].b <= cb[ib].b));
+      const TChange& first = first_a ? ca[ia] : cb[ib];
+      int lo = first.b;
+      int hi = lo + first.blen;
+      int na = 0, nb = 0; // changes of A/B in hunk
+      int ga = 0, gb = 0; // length change of A/B in hunk
+      if(first_a) {ga += first.olen - first.blen; ia++; na++;}
+      else        {gb += first.olen - first.blen; ib++; nb++;}
+      for(bool more = true; more; ) {
+	 more = false;
+	 for(; (ia < ca.size()) && touches(ca[ia], lo, hi); ia++, na++, more = true) {
+	    hi = tMax(hi, ca[ia].b + ca[ia].blen);
+	    ga += ca[ia].olen - ca[ia].blen;
+	 }
+	 for(; (ib < cb.size()) && touches(cb[ib], lo, hi); ib++, nb++, more = true) {
+	    hi = tMax(hi, cb[ib].b + cb[ib].blen);
+	    gb += cb[ib].olen - cb[ib].blen;
+	 }
+      }
+      THunk h;
+      h.start[0] = lo;
+      h.len[0] = hi - lo;
+      h.start[1] = lo + da;
+      h.len[1] = hi - lo + ga;
+      h.start[2] = lo + db;
+      h.len[2] = hi - lo + gb;
+      da += ga;
+      db += gb;
+      if(nb == 0)             h.cls = ONLY_A;
+      else if(na == 0)        h.cls = ONLY_B;
+      else if(sameContent(h)) h.cls = BOTH;
+      else                    h.cls = CONFLICT;
+      hunks += h;
+   }
+}
+
+
+int TDiff3::compare() {
+   tvector<int> order;
+   order += 0;
+   order += 1;
+   run(2, ac.getInt("jobs") == 1 ? 1 : 2, order);
+   for(int i=0; i<2; i++) {
+      if(exitStatus(i)) 
+	userError("diff of '%s' against '%s' failed!\n", (i ? fb : fa).name(), base.name());
+      int n = *(const int *)result(i);
+      changes[i].resize(n);
+      rewind(tmp[i]);
+      if(n && (fread(&changes[i][0], sizeof(TChange), n, tmp[i]) != size_t(n)))
+	userError("error while reading temporary file!\n");
+   }
+   merge();
+   
+   if(ac("json")) printJSON();
+   else print();
+   for(size_t h=0; h<hunks.size(); h++) 
+     if(hunks[h].cls == CONFLICT) return 1;
+   return 0;
+}
+
+
+void TDiff3::printJSON() const {
+   const TROTFile *file[3] = {&base, &fa, &fb};
+   static const char *key[3] = {"base", "a", "b"};
+   int n[NUM_CLASSES] = {0, 0, 0, 0};
+   printf("{\n");
+   for(int f=0; f<3; f++) {
+      printf("  \"%s\": {\"name\": ", key[f]);
+      printJSONString(stdout, file[f]->name());
+      printf(", \"size\": %d},\n", file[f]->size());
+   }
+   printf("  \"hunks\": [");
+   for(size_t h=0; h<hunks.size(); h++) {
+      const THunk& k = hunks[h];
+      n[k.cls]++;
+      printf("%s\n    {\"class\": \"%s\"", h?",":"", className(k.cls));
+      for(int f=0; f<3; f++) printf(", \"%s\": [%d, %d]", key[f], k.start[f], k.len[f]);
+      printf("}");
+   }
+   printf("\n  ],\n  \"only_a\": %d, \"only_b\": %d, \"both\": %d, \"conflicts\": %d\n}\n", 
+	  n[ONLY_A], n[ONLY_B], n[BOTH], n[CONFLICT]);
+}
+
+
+// print one row of three columns, each padded to col visible chars
+static void printRow(const tstring *text, const char **color, int col) {
+   for(int f=0; f<3; f++) {
+      if(f) printf("%s|%s", color_sep, color_nor);
+      printf("%s%-*.*s%s", color[f], col, col, text[f].data(), color_nor);
+   }
+   printf("\n");
+}
+
+
+void TDiff3::printHunk(const THunk& h, int bytes_per_row, int col) {
+   TROTFile *file[3] = {&base, &fa, &fb};
+   bool changed[3] = {false, h.cls != ONLY_B, h.cls != ONLY_A};
+   const char *ccolor = (h.cls == CONFLICT) ? color_con : ((h.cls == BOTH) ? color_both : color_one);
+   const char *color[3];
+   static const char *what[NUM_CLASSES] = {"changed", "changed", "same change", "conflict"};
+   tstring text[3];
+   char buf[64];
+   int f;
+   
+   // header: ranges
+   for(f=0; f<3; f++) {
+      color[f] = changed[f] ? ccolor : color_nor;
+      sprintf(buf, "%08X: %d %s", h.start[f], h.len[f], 
+	      f ? (changed[f] ? what[h.cls] : "unchanged") : "base");
+      text[f] = buf;
+   }
+   printRow(text, color, col);
+   if(ac("range")) return;
+   
+   // hex dump
+   int rows = 0;
+   for(f=0; f<3; f++) rows = tMax(rows, (h.len[f] + bytes_per_row - 1) / bytes_per_row);
+   for(int r=0; r<rows; r++) {
+      for(f=0; f<3; f++) {
+	 int o = r * bytes_per_row;
+	 text[f] = "";
+	 if(o >= h.len[f]) continue;
+	 sprintf(buf, "%08X: ", h.start[f] + o);
+	 text[f] = buf;
+	 for(int k=0; (k<bytes_per_row) && (o+k<h.len[f]); k++) {
+	    sprintf(buf, "%02X ", (*file[f])[h.start[f] + o + k]);
+	    text[f] += buf;
+	 }
+      }
+      printRow(text, color, col);
+   }
+}
+
+
+void TDiff3::print() {
+   if(ac("no-color")) color_nor = color_one = color_con = color_both = color_mat = color_sep = "";
+   int width = ac.getInt("width");
+   if(width == 0) {
+      struct winsize win;
+      if(ioctl(1, TIOCGWINSZ, &win) == 0) width = win.ws_col;
+      else width = 80;
+   }
+   if(width < 65) width = 65;
+   int col = (width - 2) / 3;
+   int bytes_per_row = (col - 10) / 3;
+   if((ac.getInt("bytes-per-line") > 0) && (ac.getInt("bytes-per-line") < bytes_per_row)) 
+     bytes_per_row = ac.getInt("bytes-per-line");
+   
+   const TROTFile *file[3] = {&base, &fa, &fb};
+   static const char *title[3] = {"base", "A", "B"};
+   const char *plain[3] = {color_nor, color_nor, color_nor};
+   const char *mat[3] = {color_mat, color_mat, color_mat};
+   tstring text[3];
+   char buf[64];
+   int f;
+   for(f=0; f<3; f++) text[f] = tstring(title[f]) + ": " + file[f]->name();
+   printRow(text, plain, col);
+   
+   // hunks and the unchanged regions between them
+   int n[NUM_CLASSES] = {0, 0, 0, 0};
+   int pos[3] = {0, 0, 0};
+   for(size_t h=0; h<=hunks.size(); h++) {
+      int end = (h < hunks.size()) ? hunks[h].start[0] : base.size();
+      int unchanged = end - pos[0];
+      if(unchanged && !ac("hide-match")) {
+	 for(f=0; f<3; f++) {
+	    sprintf(buf, "%08X: %d unchanged", pos[f], unchanged);
+	    text[f] = buf;
+	 }
+	 printRow(text, mat, col);
+      }
+      if(h == hunks.size()) break;
+      const THunk& k = hunks[h];
+      n[k.cls]++;
+      printHunk(k, bytes_per_row, col);
+      for(f=0; f<3; f++) pos[f] = k.start[f] + k.len[f];
+   }
+   printf("%d hunks: %d only in A, %d only in B, %d identical in both, %d conflicts\n",
+	  int(hunks.size()), n[ONLY_A], n[ONLY_B], n[BOTH], n[CONFLICT]);
+}
@@ -0,0 +1,109 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+
+#ifndef _tdiff3_h_
+#define _tdiff3_h_
+
+#include <stdio.h>
+#include "tjobpool.h"
+#include "tappconfig.h"
+#include "trotfile.h"
+#include "tdiffsink.h"
+
+// one change of an edit script against the base: base[b..b+blen-1] is
+// replaced by other[o..o+olen-1]
+struct TChange {
+   int b, blen;
+   int o, olen;
+};
+
+
+// sink which collects the changes of an edit script (adjacent ones merged)
+class TChangeList: public TDiffSink {
+ public:
+   TChangeList(): b(0), o(0) {}
+   
+   // interface
+   void ins(int i) {add(0, i);}
+   void del(int i) {add(i, 0);}
+   void sub(int i, int ins=0, int del=0) {add(i + del, i + ins);}
+   void mat(int i) {b += i; o += i;}
+   
+   void flush() {}
+   
+   tvector<TChange> changes;
+   
+ private:
+   int b;   // current offsets
+   int o;
+   void add(int blen, int olen);
+};
+
+
+// three-way diff: base->A and base->B are diffed in parallel, the two 
+// edit scripts are merged into hunks changed only in A, only in B, 
+// identically in both or conflicting (like diff3)
+class TDiff3: public TJobPool {
+ public:
+   // ctor & dtor
+   TDiff3(const TAppConfig& ac, int numbuf, int bufsize);
+   ~TDiff3();
+   
+   // diff, merge and print, return exit status (0 no conflict, 1 conflicts)
+   int compare();
+   
+ protected:
+   int job(int i, void *result);
+   
+ private:
+   enum CLASS_T {ONLY_A, ONLY_B, BOTH, CONFLICT, NUM_CLASSES};
+   
+   // hunk: [start, start+len) in base, A and B
+   struct THunk {
+      int cls;
+      int start[3];
+      int len[3];
+   };
+   
+   // private data
+   const TAppConfig& ac;
+   TROTFile base;
+   TROTFile fa;
+   TROTFile fb;
+   FILE *tmp[2];             // edit scripts of the jobs
+   tvector<TChange> changes[2];
+   tvector<THunk> hunks;
+   
+   // private methods
+   void merge();
+   bool sameContent(const THunk& h);
+   void print();
+   void printJSON() const;
+   void printHunk(const THunk& h, int bytes_per_row, int col);
+   static const char *className(int cls);
+   
+   // forbid copy
+   TDiff3(const TDiff3&);
+   const TDiff3& operator=(const TDiff3&);
+};
+
+#endif
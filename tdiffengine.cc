@@ -0,0 +1,603 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <stdio.h>
+#include <string.h>
+#include "tdiffengine.h"
+#include "tminmax.h"
+#include "tprofile.h"
+#include "tvector.h"
+
+
+bool prog = false;
+
+
+#ifndef QDIFF_NO_PROFILE
+// counts and times one syncronize() call
+class TSyncProfile {
+ public:
+   TSyncProfile(): compares(profile.compares), start(profileClock()) {profile.syncs++;}
+   ~TSyncProfile() {
+      profile.syncTime += profileClock() - start;
+      if(profile.compares - compares > profile.maxCompares) 
+	profile.maxCompares = profile.compares - compares;
+   }
+ private:
+   long long compares;
+   double start;
+};
+#endif
+
+
+// number of equal bytes at the start of a and b (n at most), compared 
+// word by word
+static inline int equalBytes(const uchar *a, const uchar *b, int n) {
+   int i = 0;
+   for(; i+8 <= n; i += 8) {
+      unsigned long long x, y;
+      memcpy(&x, a+i, 8);
+      memcpy(&y, b+i, 8);
+      if(x != y) break;
+   }
+   for(; (i<n) && (a[i]==b[i]); i++) ;
+   return i;
+}
+
+
+// number of zero bytes at the start of a (n at most)
+static inline int zeroBytes(const uchar *a, int n) {
+   int i = 0;
+   for(; i+8 <= n; i += 8) {
+      unsigned long long x;
+      memcpy(&x, a+i, 8);
+      if(x) break;
+   }
+   for(; (i<n) && (a[i]==0); i++) ;
+   return i;
+}
+
+
+// number of zero bytes of f at o (n at most)
+static int zeroRun(TROTFile& f, int o, int n) {
+   int i = 0;
+   while(i < n) {
+      int k = tMin(f.spanLen(o+i), n-i);
+      int m = zeroBytes(f.span(o+i, k), k);
+      i += m;
+      if(m < k) break;
+   }
+   return i;
+}
+
+
+int match(TROTFile& f1, int o1, TROTFile& f2, int o2) {
+   int s1 = f1.size();
+   int s2 = f2.size();
+   int i1 = o1;
+   int i2 = o2;
+   int print = 256*1024;
+   int pri = print;
+   bool holes = f1.hasHoles() || f2.hasHoles();
+   bool located = f1.hasLocations() && f2.hasLocations();
+
+   // span by span: each piece lies in one buffer of each file
+   while((i1<s1) && (i2<s2)) {
+      int n = tMin(f1.spanLen(i1), f2.spanLen(i2));
+      if(holes || located) {
+	 // data at the same place on the device is the same (reflinks)
+	 if(located) {
+	    int l1, l2;
+	    off_t p1 = f1.location(i1, l1);
+	    if((p1 >= 0) && (p1 == f2.location(i2, l2))) {
+	       int m = tMin(l1, l2);
+	       PROFILE(profile.sharedBytes += m);
+	       i1 += m;
+	       i2 += m;
+	       continue;
+	    }
+	 }
+	 // a hole matches a hole without reading and data only needs a
+	 // zero check, data against data stops at the next hole
+	 int h1 = f1.holeLen(i1);
+	 int h2 = f2.holeLen(i2);
+	 if(h1 && h2) {
+	    int m = tMin(h1, h2);
+	    PROFILE(profile.holeBytes += m);
+	    i1 += m;
+	    i2 += m;
+	    continue;
+	 }
+	 if(h1 || h2) {
+	    int k = h1 ? tMin(h1, f2.dataLen(i2)) : tMin(h2, f1.dataLen(i1));
+	    int m = h1 ? zeroRun(f2, i2, k) : zeroRun(f1, i1, k);
+	    PROFILE(profile.holeBytes += m);
+	    i1 += m;
+	    i2 += m;
+	    if(m < k) break;
+	    continue;
+	 }
+	 n = tMin(n, tMin(f1.dataLen(i1), f2.dataLen(i2)));
+      }
+      const uchar *p1 = f1.span(i1, n);
+      const uchar *p2 = f2.span(i2, n);
+      int m = equalBytes(p1, p2, n);
+      i1 += m;
+      i2 += m;
+      if(m < n) break;
+      if(prog && ((pri -= m) <= 0)) {
+	 pri = print;
+	 fprintf(stderr, "mat(%5dK,%5dK)  \r", i1>>10, i2>>10);
+	 fflush(stderr);
+      }
+   }
+   return i1 - o1;
+}
+
+
+// the kernels below are instantiated for common min-match values MM (see 
+// kernelTable), MM 0 is the generic one using the runtime value
+
+
+template<int MM>
+static int substKernel(TROTFile& f1, int o1, TROTFile& f2, int o2, int minmatch) {
+   if(MM) minmatch = MM; // compile time constant in the specialisations
+   int s1 = f1.size();
+   int s2 = f2.size();
+   int mis = -1;
+   int i = 0;
+   int print = 256*1024;
+   int pri = print;
+   PROFILE(TSyncProfile sp);
+
+   // span by span: skip equal runs word by word
+   while((o1+i < s1) && (o2+i < s2)) {
+      int n = tMin(f1.spanLen(o1+i), f2.spanLen(o2+i));
+      const uchar *p1 = f1.span(o1+i, n);
+      const uchar *p2 = f2.span(o2+i, n);
+      for(int k=0; k<n; ) {
+	 int m = equalBytes(p1+k, p2+k, n-k);
+	 if(i + m - mis > minmatch) return mis + 1; // match of len minmatch
+	 i += m;
+	 k += m;
+	 if(k < n) {
+	    mis = i++;
+	    k++;
+	 }
+      }
+      if(prog && ((pri -= n) <= 0)) {
+	 pri = print;
+	 fprintf(stderr, "syn(%5dK,%5dK)  \r", (o1+i)>>10, (o2+i)>>10);
+	 fflush(stderr);
+      }
+   }
+   return i; // eof
+}
+
+
+// return true if minmatch bytes match at o1/o2 in f1/f2
+template<int MM>
+static inline bool compare(TROTFile& f1, int o1, TROTFile& f2, int o2, 
+			   int minmatch) {
+   if(MM) minmatch = MM;
+   int i1=o1;
+   int i2=o2;
+   
+   PROFILE(profile.compares++);
+   if((f1.size()-i1) < minmatch) return false;
+   if((f2.size()-i2) < minmatch) return false;
+   const uchar *p1 = f1.span(i1, minmatch);
+   const uchar *p2 = p1 ? f2.span(i2, minmatch) : 0;
+   if(p2) return equalBytes(p1, p2, minmatch) == minmatch;
+   for(int i=0; i<minmatch; i++, i1++, i2++)
+     if(f1[i1] != f2[i2]) return false;
+   return true;
+}
+
+
+const char *syncName(SYNC_T how) {
+   switch(how) {
+    case SYNC_EXACT:     return "exhaustive search";
+    case SYNC_HEURISTIC: return "heuristic search";
+    case SYNC_ANCHOR:    return "block hash anchor";
+    case SYNC_SUBST:     return "substitution";
+    case SYNC_WINDOW:    return "no sync within max shift";
+   }
+   return "";
+}
+
+
+// the first (up to 4) bytes at each position after an offset as one word:
+// candidates with different fingerprints can not match, so most of them
+// are rejected without compare(); grown on demand up to maxFingerprints
+// (not used for min-match 1, where compare() is as cheap)
+static const int maxFingerprints = 8*1024*1024;
+class TFingerprints {
+ public:
+   TFingerprints(TROTFile& file, int offset, int minmatch):
+   f(file), o(offset), len(tMin(minmatch, 4)) {}
+   // make positions 0..n-1 available, false if too many
+   bool extend(int n) {
+      if(n <= int(fp.size())) return true;
+      if(n > maxFingerprints) return false;
+      int k = fp.size();
+      if(n < 2*k) n = tMin(2*k, maxFingerprints); // grow geometrically
+      fp.reserve(n);
+      TROTFile::adviseHuge(fp.data(), n * sizeof(uint));
+      fp.resize(n);
+      // rolling: shift out the first byte, shift in the next one
+      uint w = 0;
+      if(k) w = fp[k-1];
+      else for(int b=0; (b<len-1) && (o+b < f.size()); b++) w |= uint(f[o+b]) << (8*(b+1));
+      for(; k<n; k++) {
+	 w >>= 8;
+	 if(o+k+len-1 < f.size()) w |= uint(f[o+k+len-1]) << (8*(len-1));
+	 fp[k] = w;
+      }
+      return true;
+   }
+   uint operator[](int k) const {return fp[k];}
+ private:
+   TROTFile& f;
+   int o;
+   int len;
+   tvector<uint> fp;
+};
+
+
+// tracks the budget of one resync strategy
+class TBudget {
+ public:
+   TBudget(const TSyncBudget *b): budget(b), deadline(0), work(0) {restart();}
+   void restart() {
+      work = 0;
+      if(budget && (budget->seconds > 0)) deadline = profileClock() + budget->seconds;
+   }
+   bool exhausted(long long addwork) {
+      if(budget == 0) return false;
+      work += addwork;
+      if((budget->compares > 0) && (work > budget->compares)) return true;
+      return (deadline > 0) && (profileClock() > deadline);
+   }
+ private:
+   const TSyncBudget *budget;
+   double deadline;
+   long long work;
+};
+
+
+static const int anchorBlock  = 256;           // min block size of the anchor search
+static const int anchorWindow = 256*1024*1024; // max bytes searched by the anchor search
+static const unsigned long long anchorMul = 0x9E3779B97F4A7C15ULL;
+
+
+// coarse resync: the blocks of f1 at multiples of the block size are put 
+// into a hash table and searched with a rolling hash over f2, the first 
+// verified hit is the sync point; linear in the window size
+static bool anchorSync(TROTFile& f1, int o1, TROTFile& f2, int o2, int minmatch,
+		       int window, TBudget& budget, int& out_sub, int& out_ins, 
+		       int& out_del) {
+   int block = tMax(minmatch, anchorBlock);
+   int w1 = tMin(f1.size()-o1, window);
+   int w2 = tMin(f2.size()-o2, window);
+   int nblocks = w1 / block;
+   if((nblocks == 0) || (w2 < block)) return false;
+   
+   // hash table with open addressing, key 0 is empty
+   int tsize = 1;
+   while(tsize < 2*nblocks) tsize <<= 1;
+   tvector<unsigned long long> key;
+   tvector<int> pos;
+   key.reserve(tsize);
+   pos.reserve(tsize);
+   TROTFile::adviseHuge(key.data(), tsize * sizeof(unsigned long long));
+   TROTFile::adviseHuge(pos.data(), tsize * sizeof(int));
+   key.resize(tsize, 0);
+   pos.resize(tsize, 0);
+   int b, k;
+   for(b=0; b<nblocks; b++) {
+      unsigned long long h = 0;
+      for(k=0; k<block; k++) h = h * anchorMul + f1[o1 + b*block + k] + 1;
+      h |= 1;
+      int slot = int(h >> 20) & (tsize-1);
+      while(key[slot] && (key[slot] != h)) slot = (slot+1) & (tsize-1);
+      if(key[slot] == 0) {
+	 key[slot] = h;
+	 pos[slot] = b*block;
+      }
+      if(((b & 1023) == 1023) && budget.exhausted(0)) return false;
+   }
+   
+   // roll over f2
+   unsigned long long pow = 1;
+   for(k=0; k<block; k++) pow *= anchorMul;
+   unsigned long long h = 0;
+   for(k=0; k<block; k++) h = h * anchorMul + f2[o2 + k] + 1;
+   for(int j=0; ; j++) {
+      int slot = int((h|1) >> 20) & (tsize-1);
+      while(key[slot]) {
+	 if(key[slot] == (h|1)) {
+	    int i = pos[slot];
+	    for(k=0; (k<block) && (f1[o1+i+k] == f2[o2+j+k]); k++) ;
+	    if(k == block) {
+	       while((i>0) && (j>0) && (f1[o1+i-1]==f2[o2+j-1])) {
+		  i--;
+		  j--;
+	       }
+	       out_sub = tMin(i, j);
+	       out_del = i - out_sub;
+	       out_ins = j - out_sub;
+	       return true;
+	    }
+	    break;
+	 }
+	 slot = (slot+1) & (tsize-1);
+      }
+      if(j + block >= w2) return false;
+      h = h * anchorMul + f2[o2 + j + block] + 1 - pow * (f2[o2 + j] + 1);
+      if(((j & 0xfffff) == 0xfffff) && budget.exhausted(0)) return false;
+   }
+}
+
+
+template<int MM>
+static SYNC_T syncKernel(TROTFile& f1, int o1, TROTFile& f2, int o2, int minmatch,
+			 bool heurist, int maxshift, int& out_sub, int& out_ins, 
+			 int& out_del, const TSyncBudget *budget) {
+   if(MM) minmatch = MM;
+   out_ins = 0;
+   out_del = 0;
+   out_sub = 0;
+   PROFILE(TSyncProfile sp);
+   SYNC_T how = heurist ? SYNC_HEURISTIC : SYNC_EXACT;
+   
+   // check for eof:
+   if(o1==f1.size()) {
+      out_ins = f2.size()-o2;
+      return how;
+   }
+   if(o2==f2.size()) {
+      out_del = f1.size()-o1;
+      return how;
+   }
+   
+   // simple diff engine: search for sync
+   TBudget bud(budget);
+   int max_i = tMax(f1.size()-o1, f2.size()-o2) - minmatch;
+   bool windowed = (maxshift > 0) && (max_i > maxshift);
+   if(windowed) max_i = maxshift;
+   int print = 20;
+   if(!prog) print=-1;
+   TFingerprints fp1(f1, o1, minmatch);
+   TFingerprints fp2(f2, o2, minmatch);
+   for(int i=0; i <= max_i; i++, print--) {
+      bool usefp = (minmatch > 1) && fp1.extend(i+1) && fp2.extend(i+1);
+      for(int j=0; j <= i; j++) {
+	 if((!usefp || (fp1[i] == fp2[j])) && compare<MM>(f1, o1+i, f2, o2+j, minmatch)) {
+	    if(heurist) {
+	       while((i>0) && (j>0) && (f1[o1+i-1]==f2[o2+j-1])) {
+		  i--;
+		  j--;
+	       }
+	    }
+	    out_sub = j;
+	    out_del = i-j;
+	    return how;
+	 }
+	 if((!usefp || (fp1[j] == fp2[i])) && compare<MM>(f1, o1+j, f2, o2+i, minmatch)) {
+	    if(heurist) {
+	       while((i>0) && (j>0) && (f1[o1+j-1]==f2[o2+i-1])) {
+		  i--;
+		  j--;
+	       }
+	    }
+	    out_sub = j;
+	    out_ins = i-j;
+	    return how;
+	 }
+      }
+      if(heurist) i += i/10;
+      if(print==0) {
+	 print=heurist?10:100;
+	 fprintf(stderr, "syncing byte range%8d (%s)\r", i, heurist?"heuristic":"exhaustive");
+      }
+      if(bud.exhausted(2*(long long)(i+1))) {
+	 // degrade: exhaustive -> heuristic -> anchor -> substitution
+	 bud.restart();
+	 if(!heurist) {
+	    heurist = true;
+	    how = SYNC_HEURISTIC;
+	    continue;
+	 }
+	 if(anchorSync(f1, o1, f2, o2, minmatch, maxshift ? tMin(maxshift, anchorWindow) : anchorWindow,
+		       bud, out_sub, out_ins, out_del))
+	   return SYNC_ANCHOR;
+	 out_sub = substKernel<MM>(f1, o1, f2, o2, minmatch);
+	 return SYNC_SUBST;
+      }
+   }
+   
+   // no sync within the window: substitute one window, this keeps the 
+   // search linear in the file size
+   if(windowed) {
+      out_sub = tMin(maxshift, tMin(f1.size()-o1, f2.size()-o2));
+      return SYNC_WINDOW;
+   }
+   
+   // no sync found: 
+   out_sub = tMin(f1.size()-o1, f2.size()-o2);
+   out_del = f1.size() - o1 - out_sub;
+   out_ins = f2.size() - o2 - out_sub;
+   return how;
+}
+
+
+
+
+
+
+
+// kernels for one min-match value
+typedef SYNC_T (*TSyncKernel)(TROTFile&, int, TROTFile&, int, int, bool, int, 
+			      int&, int&, int&, const TSyncBudget *);
+typedef int (*TSubstKernel)(TROTFile&, int, TROTFile&, int, int);
+struct TKernels {
+   int minmatch;
+   TSyncKernel sync;
+   TSubstKernel subst;
+};
+
+static const TKernels kernelTable[] = {
+   {4,  syncKernel<4>,  substKernel<4>},
+   {8,  syncKernel<8>,  substKernel<8>},
+   {16, syncKernel<16>, substKernel<16>},
+   {20, syncKernel<20>, substKernel<20>},
+   {32, syncKernel<32>, substKernel<32>},
+   {64, syncKernel<64>, substKernel<64>},
+   {0,  syncKernel<0>,  substKernel<0>}  // generic, must be last
+};
+
+
+static const TKernels& selectKernels(int minmatch) {
+   const TKernels *k = kernelTable;
+   while(k->minmatch && (k->minmatch != minmatch)) k++;
+   return *k;
+}
+
+
+int syncronizeOnlySubst(TROTFile& f1, int o1, TROTFile& f2, int o2, 
+			int minmatch) {
+   return selectKernels(minmatch).subst(f1, o1, f2, o2, minmatch);
+}
+
+
+SYNC_T syncronize(TROTFile& f1, int o1, TROTFile& f2, int o2, int minmatch,
+		  bool heurist, int maxshift, int& out_sub, int& out_ins, 
+		  int& out_del, const TSyncBudget *budget) {
+   return selectKernels(minmatch).sync(f1, o1, f2, o2, minmatch, heurist, maxshift,
+				       out_sub, out_ins, out_del, budget);
+}
+
+
+// bytes of f the buffers hold besides the two at the current offsets: a
+// larger search window would thrash them (a mapped file has no bound)
+static int bufferWindow(TROTFile& f) {
+   if((TROTFile::io == TROTFile::IO_MMAP) && f.isRegular()) return 0x7fffffff;
+   return int(tMin(double(f.numBuf() - 2) * f.bufSize(), double(0x7fffffff)));
+}
+
+
+// no limit up to 16MB, then 1/64 of the larger file (at least 16MB)
+int autoMaxShift(int size1, int size2) {
+   int s = tMax(size1, size2);
+   if(s <= 16*1024*1024) return 0;
+   return tMax(16*1024*1024, s/64);
+}
+
+
+// diff f1 against f2, write edit script to out
+void diff(TROTFile& f1, TROTFile& f2, TDiffSink& out, const TAppConfig& ac,
+	  TDiffPoints *points) {
+   int s1=f1.size();
+   int s2=f2.size();
+   
+   // additional config
+   bool bytebybyte = ac("byte-by-byte");
+   bool stoponeof = ac("stop-on-eof");
+   bool heurist = !ac("no-heuristics");
+   int minmatch = ac.getInt("min-match");
+   TSyncBudget budget;
+   budget.seconds = ac.getDouble("sync-time");
+   budget.compares = ac.getInt("sync-work") * 1000000LL;
+   bool budgeted = (budget.seconds > 0) || (budget.compares > 0);
+   int maxshift = ac.getInt("max-shift");
+   if(maxshift < 0) {
+      // the default stays within the buffer memory (see --buffer-memory)
+      maxshift = autoMaxShift(s1, s2);
+      int window = tMin(bufferWindow(f1), bufferWindow(f2)) - minmatch;
+      if(maxshift > 0) maxshift = tMax(1, tMin(maxshift, window));
+   }
+   const TKernels& kernels = selectKernels(minmatch);
+   f1.shareExtents(f2);
+   
+   // do diff
+   int o1 = points ? points->start1 : 0;
+   int o2 = points ? points->start2 : 0;
+   int i;
+   int ins, del, sub;
+   while((s1!=o1)&&(s2!=o2)&&!out.full()) {
+      if(bytebybyte) {
+	 i = kernels.subst(f1, o1, f2, o2, minmatch);
+	 if(i) out.sub(i);
+	 o1 += i;
+	 o2 += i;
+      } else {
+	 SYNC_T how = kernels.sync(f1, o1, f2, o2, minmatch, heurist, maxshift, 
+				   sub, ins, del, budgeted ? &budget : 0);
+	 if(how != (heurist ? SYNC_HEURISTIC : SYNC_EXACT)) out.degraded(syncName(how));
+	 // no sync within max shift: the windows up to the next match of
+	 // at least minmatch bytes or sync are one substitution with a single
+	 // note, like SYNC_SUBST
+	 while((how == SYNC_WINDOW) && (o1 + sub < s1) && (o2 + sub < s2) &&
+	       (match(f1, o1 + sub, f2, o2 + sub) < minmatch)) {
+	    int more;
+	    how = kernels.sync(f1, o1 + sub, f2, o2 + sub, minmatch, heurist, maxshift, 
+			       more, ins, del, budgeted ? &budget : 0);
+	    sub += more;
+	 }
+	 if(sub) out.sub(sub, ins, del);
+	 else {
+	    if(del) out.del(del);
+	    if(ins) out.ins(ins);
+	 }
+	 o1 += sub + del;
+	 o2 += sub + ins;
+      }
+      PROFILE(double t = profileClock());
+      i = match(f1, o1, f2, o2);
+      PROFILE(profile.matchTime += profileClock() - t);
+      if(i) out.mat(i);
+      o1 += i;
+      o2 += i;
+      if(points) points->point(o1, o2);
+   }
+   if(out.full()) {
+      // output limits reached: the rest is not diffed
+      out.flush();
+      return;
+   }
+   if((o1 != s1) && (o2 != s2))
+     fatalError("internal error: (o1!=s1) && (o2!=s2)\n");
+   if(o1 != s1) {
+      if(stoponeof) {
+	 out.flush();
+	 printf("eof in file '%s', %d uncompared bytes follow in file '%s'\n",
+		f2.name(), s1-o1, f1.name());
+      } else out.del(s1-o1);
+   }
+   if(o2 != s2) {
+      if(stoponeof) {
+	 out.flush();
+	 printf("eof in file '%s', %d uncompared bytes follow in file '%s'\n",
+		f1.name(), s2-o2, f2.name());
+      } else out.ins(s2-o2);
+   }
+   out.flush();
+}
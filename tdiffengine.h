@@ -0,0 +1,77 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tdiffengine_h_
+#define _tdiffengine_h_
+
+#include "trotfile.h"
+#include "tdiffsink.h"
+#include "tappconfig.h"
+
+// show progress during match/sync
+extern bool prog;
+
+// length of match at o1/o2
+int match(TROTFile& f1, int o1, TROTFile& f2, int o2);
+
+// length of substitution at o1/o2 until minmatch bytes match (or eof)
+int syncronizeOnlySubst(TROTFile& f1, int o1, TROTFile& f2, int o2, 
+			int minmatch);
+
+// resync strategies, from the best to the cheapest one
+// (SYNC_WINDOW: no sync within max shift, a window sized substitution)
+enum SYNC_T {SYNC_EXACT, SYNC_HEURISTIC, SYNC_ANCHOR, SYNC_SUBST, SYNC_WINDOW};
+const char *syncName(SYNC_T how);
+
+// budget of each strategy of one resync, 0 means no limit: when it is
+// exhausted syncronize() falls back to the next cheaper strategy
+struct TSyncBudget {
+   double seconds;      // time
+   long long compares;  // candidate positions compared
+};
+
+// search the next sync point after o1/o2 with a shift of at most maxshift 
+// bytes (0: no limit): returns the lengths of the substitution, insertion
+// and deletion before it and the strategy used
+SYNC_T syncronize(TROTFile& f1, int o1, TROTFile& f2, int o2, int minmatch,
+		  bool heurist, int maxshift, int& out_sub, int& out_ins, 
+		  int& out_del, const TSyncBudget *budget = 0);
+
+// default of --max-shift for files of these sizes
+int autoMaxShift(int size1, int size2);
+
+// receives the points where diff() can be continued later (after each
+// match) and gives the one to start at, see TCheckpoint and TWatch
+class TDiffPoints {
+ public:
+   TDiffPoints(): start1(0), start2(0) {}
+   virtual ~TDiffPoints() {}
+   virtual void point(int o1, int o2) = 0;
+   int start1;   // offsets the diff starts at
+   int start2;
+};
+
+// diff f1 against f2, write edit script to out, from the start offsets
+// of points and passing the points reached to it if given
+void diff(TROTFile& f1, TROTFile& f2, TDiffSink& out, const TAppConfig& ac,
+	  TDiffPoints *points = 0);
+
+#endif
@@ -0,0 +1,222 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include "tdiffindex.h"
+#include "tdiffengine.h"
+#include "tcheckpoint.h"
+#include "terror.h"
+#include "tminmax.h"
+
+typedef unsigned long long u64;
+
+static const char indexMagic[8] = {'Q','D','I','F','F','I','X','1'};
+static const int headerLen = 48;   // magic, sizes, hashes, records
+static const int recordLen = 24;   // type, o1, o2, num, ins, del
+static const u64 incomplete = ~0ULL;
+
+
+static void putLE(uchar *p, u64 v, int n) {
+   for(int i=0; i<n; i++, v >>= 8) p[i] = uchar(v & 0xff);
+}
+
+static u64 getLE(const uchar *p, int n) {
+   u64 v = 0;
+   for(int i=0; i<n; i++) v |= u64(p[i]) << (8*i);
+   return v;
+}
+
+
+// file format: magic, sizes and hashes of the files, number of records
+// (all ones until the index is complete), then the records; all numbers
+// little endian, 64 bit in the header and 32 bit in the records
+TDiffIndex::TDiffIndex(const char *filename, TROTFile& file1, TROTFile& file2):
+fname(filename), f(0), f1(file1), f2(file2), o1(0), o2(0), records(0), truncated(false)
+{
+   f = fopen(filename, "wb");
+   if(f == 0) userError("can't open '%s' for writing!\n", filename);
+   setvbuf(f, 0, _IOFBF, 1 << 20);
+   uchar h[headerLen];
+   memcpy(h, indexMagic, sizeof(indexMagic));
+   putLE(h + 8, f1.size(), 8);
+   putLE(h + 16, f2.size(), 8);
+   putLE(h + 24, TCheckpoint::inputHash(f1, f1.size()), 8);
+   putLE(h + 32, TCheckpoint::inputHash(f2, f2.size()), 8);
+   putLE(h + 40, incomplete, 8);
+   fwrite(h, 1, headerLen, f);
+}
+
+
+TDiffIndex::~TDiffIndex() {
+   if(f) fclose(f);
+}
+
+
+void TDiffIndex::put(EVENT_T type, int num, int ins, int del) {
+   uchar r[recordLen];
+   putLE(r, type, 4);
+   putLE(r + 4, o1, 4);
+   putLE(r + 8, o2, 4);
+   putLE(r + 12, num, 4);
+   putLE(r + 16, ins, 4);
+   putLE(r + 20, del, 4);
+   fwrite(r, 1, recordLen, f);
+   records++;
+}
+
+
+void TDiffIndex::ins(int i) {
+   put(INS, i, 0, 0);
+   o2 += i;
+}
+
+
+void TDiffIndex::del(int i) {
+   put(DEL, i, 0, 0);
+   o1 += i;
+}
+
+
+void TDiffIndex::sub(int i, int ins, int del) {
+   put(SUB, i, ins, del);
+   o1 += i + del;
+   o2 += i + ins;
+}
+
+
+void TDiffIndex::mat(int i) {
+   put(MAT, i, 0, 0);
+   o1 += i;
+   o2 += i;
+}
+
+
+void TDiffIndex::degraded(const char *how) {
+   int s;
+   for(s = SYNC_EXACT; (s < SYNC_WINDOW) && strcmp(how, syncName(SYNC_T(s))); s++) ;
+   put(DEGRADED, s, 0, 0);
+}
+
+
+// the record count in the header marks the index complete; the events
+// end before the end of the files if the diff was stopped early
+void TDiffIndex::flush() {
+   if(!truncated && ((o1 < f1.size()) || (o2 < f2.size()))) {
+      put(TRUNCATED, 0, 0, 0);
+      truncated = true;
+   }
+   uchar n[8];
+   putLE(n, records, 8);
+   if(fflush(f) || fseeko(f, headerLen - 8, SEEK_SET) || (fwrite(n, 1, 8, f) != 8) ||
+      fseeko(f, 0, SEEK_END) || fflush(f))
+     userError("error while writing index '%s'!\n", fname.data());
+}
+
+
+void TDiffIndex::seekRecord(FILE *f, long long i) {
+   fseeko(f, headerLen + off_t(i) * recordLen, SEEK_SET);
+}
+
+
+bool TDiffIndex::get(FILE *f, TRecord& r) {
+   uchar b[recordLen];
+   if(fread(b, 1, recordLen, f) != size_t(recordLen)) return false;
+   r.type = EVENT_T(getLE(b, 4));
+   r.o1 = int(getLE(b + 4, 4));
+   r.o2 = int(getLE(b + 8, 4));
+   r.num = int(getLE(b + 12, 4));
+   r.ins = int(getLE(b + 16, 4));
+   r.del = int(getLE(b + 20, 4));
+   return r.type <= TRUNCATED;
+}
+
+
+void TDiffIndex::send(const TRecord& r, TDiffSink& out) {
+   switch(r.type) {
+    case MAT: out.mat(r.num); break;
+    case SUB: out.sub(r.num, r.ins, r.del); break;
+    case DEL: out.del(r.num); break;
+    case INS: out.ins(r.num); break;
+    case DEGRADED: out.degraded(syncName(SYNC_T(r.num))); break;
+    case TRUNCATED: break;
+   }
+}
+
+
+void TDiffIndex::replay(const char *fname, TROTFile& f1, TROTFile& f2, TDiffSink& out,
+			int from, int to) {
+   FILE *f = fopen(fname, "rb");
+   if(f == 0) userError("can't open index '%s'!\n", fname);
+   uchar h[headerLen];
+   struct stat st;
+   bool ok = (fread(h, 1, headerLen, f) == size_t(headerLen)) &&
+     (memcmp(h, indexMagic, sizeof(indexMagic)) == 0) && (fstat(fileno(f), &st) == 0);
+   u64 n = ok ? getLE(h + 40, 8) : 0;
+   if(!ok || (n == incomplete) || (u64(st.st_size) != headerLen + n * recordLen))
+     userError("'%s' is not a complete index!\n", fname);
+   if((getLE(h + 8, 8) != u64(f1.size())) || (getLE(h + 16, 8) != u64(f2.size())) ||
+      (getLE(h + 24, 8) != TCheckpoint::inputHash(f1, f1.size())) ||
+      (getLE(h + 32, 8) != TCheckpoint::inputHash(f2, f2.size())))
+     userError("'%s' is not the index of these files, or they changed since it was saved!\n", fname);
+   bool all = (to == 0) || (to >= f1.size());
+   if(all) to = f1.size();
+
+   // first event ending after from in f1, insertions at from included:
+   // the events are sorted by their start and their end
+   long long lo = 0, hi = n;
+   TRecord r;
+   while(lo < hi) {
+      long long mid = lo + (hi - lo) / 2;
+      seekRecord(f, mid);
+      if(!get(f, r)) userError("'%s' is not a complete index!\n", fname);
+      int len1 = (r.type == MAT || r.type == DEL) ? r.num : (r.type == SUB) ? r.num + r.del : 0;
+      if((r.o1 + len1 > from) || (r.o1 >= from)) hi = mid;
+      else lo = mid + 1;
+   }
+
+   seekRecord(f, lo);
+   for(long long i=lo; (i < (long long)n) && !out.full(); i++) {
+      if(!get(f, r)) userError("'%s' is not a complete index!\n", fname);
+      if((r.o1 >= to) && !all) break;
+      if(i == lo) {
+	 // a match is cut at from, everything else printed from its start
+	 if((r.type == MAT) && (r.o1 < from)) {
+	    r.num -= from - r.o1;
+	    r.o2 += from - r.o1;
+	    r.o1 = from;
+	 }
+	 if(r.o1 || r.o2) out.seek(r.o1, r.o2);
+      }
+      if(r.type == MAT) r.num = tMin(r.num, to - r.o1);
+      if(r.type == TRUNCATED) {
+	 out.flush();
+	 userWarning("index '%s' ends at 0x%08X : 0x%08X, the diff was stopped early when it was saved\n",
+		     fname, r.o1, r.o2);
+	 fclose(f);
+	 return;
+      }
+      send(r, out);
+   }
+   out.flush();
+   fclose(f);
+}
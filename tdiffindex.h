@@ -0,0 +1,86 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tdiffindex_h_
+#define _tdiffindex_h_
+
+#include <stdio.h>
+#include "trotfile.h"
+#include "tdiffsink.h"
+
+// index of the edit script of two files (see --save-index and --index):
+// one fixed size record per event with the offsets it starts at, so the
+// diff can be printed again in any output mode, or only a part of it
+// found by binary search, without running the engine; a diff stopped
+// early (--max-hunks, --max-output-bytes, --stop-on-eof) ends with a
+// TRUNCATED record
+class TDiffIndex: public TDiffSink {
+ public:
+   // write the index of the diff of f1 and f2 to fname
+   TDiffIndex(const char *fname, TROTFile& f1, TROTFile& f2);
+   ~TDiffIndex();
+
+   // interface
+   void ins(int i);
+   void del(int i);
+   void sub(int i, int ins=0, int del=0);
+   void mat(int i);
+
+   void flush();   // completes the index, truncated if the diff stopped early
+   void degraded(const char *how);
+
+   // pass the events of the index fname of f1 and f2 to out, only those
+   // between the offsets from and to (0: end) of f1
+   static void replay(const char *fname, TROTFile& f1, TROTFile& f2, TDiffSink& out,
+		      int from, int to);
+
+ private:
+   enum EVENT_T {MAT, SUB, DEL, INS, DEGRADED, TRUNCATED};
+   // event at o1/o2, for DEGRADED num is the SYNC_T
+   struct TRecord {
+      EVENT_T type;
+      int o1;
+      int o2;
+      int num;
+      int ins;
+      int del;
+   };
+
+   tstring fname;
+   FILE *f;
+   TROTFile& f1;
+   TROTFile& f2;
+   int o1;
+   int o2;
+   long long records;
+   bool truncated;
+
+   void put(EVENT_T type, int num, int ins, int del);
+   static void seekRecord(FILE *f, long long i);
+   static bool get(FILE *f, TRecord& r);
+   static void send(const TRecord& r, TDiffSink& out);
+
+   // forbid copy
+   TDiffIndex(const TDiffIndex&);
+   const TDiffIndex& operator= (const TDiffIndex&);
+};
+
+#endif
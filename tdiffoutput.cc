@@ -19,7 +19,9 @@
  * *GPL*END*/  
 
 #include <sys/ioctl.h>
+#include <stdarg.h>
 #include "tdiffoutput.h"
+#include "tminmax.h"
 #include "ctype.h"
 
 
@@ -72,7 +74,15 @@ show_space(false),
 line_numbers(false),
 no_line_break(false),
 unprint(0),
-control_hex(false)
+control_hex(false),
+max_hunks(0),
+max_output(0),
+hunk_bytes(0),
+context(-1),
+hunks(0),
+printed(0),
+in_hunk(false),
+stopped(false)
 {
    // adjust colors
    if(ac("alt-colors")) {
@@ -193,6 +203,12 @@ control_hex(false)
    if(ac("range")) {
       range_mat = range_sub = range_ins = range_del = true;
    }
+   
+   // limits:
+   max_hunks = ac.getInt("max-hunks");
+   max_output = ac.getInt("max-output-bytes");
+   hunk_bytes = ac.getInt("hunk-bytes");
+   context = ac.getInt("context");
 
    // alloc some mem:
    linebuf1 = new char[half_line_len*16];
@@ -582,59 +598,160 @@ const char *TDiffOutput::colorStr(DIFF_T diff) const {
 }
 
 
-void TDiffOutput::printSplitLine(char *buf1, char *buf2) const {
+void TDiffOutput::printSplitLine(char *buf1, char *buf2) {
    setStrLen(buf1, half_line_len);
    setStrLen(buf2, half_line_len);
-   printf("%s%s|%s%s\n", buf1, color_sep, color_nor, buf2);
+   print("%s%s|%s%s\n", buf1, color_sep, color_nor, buf2);
+}
+
+
+// printf for the diff itself: counts the bytes for --max-output-bytes and
+// prints nothing once an output limit is reached
+void TDiffOutput::print(const char *format, ...) {
+   if(stopped) return;
+   va_list ap;
+   va_start(ap, format);
+   int n = vprintf(format, ap);
+   va_end(ap);
+   if(n > 0) printed += n;
+   if(max_output && (printed >= max_output)) stop("--max-output-bytes");
+}
+
+
+void TDiffOutput::stop(const char *why) {
+   if(stopped) return;
+   stopped = true;
+   printf("output limit %s reached, diff stopped at 0x%08X (%10d) : (%10d) 0x%08X\n",
+	  why, o1, o1, o2, o2);
+}
+
+
+// a change of n1 bytes of file 1 and n2 bytes of file 2 starts: count the
+// hunks, true if it is not printed since an output limit was reached
+bool TDiffOutput::change(int n1, int n2) {
+   if(!stopped && !in_hunk) {
+      in_hunk = true;
+      if(max_hunks && (hunks == max_hunks)) {
+	 if(mode != VERTICAL) flush();
+	 stop("--max-hunks");
+      } else hunks++;
+   }
+   if(stopped) {
+      o1 += n1;
+      o2 += n2;
+   }
+   return stopped;
+}
+
+
+// print the first and the last hunk_bytes/2 bytes of a change and a
+// marker for the bytes between, which are not read: the change consists 
+// of num substituted bytes followed by del deleted and ins inserted ones
+void TDiffOutput::elide(DIFF_T diff, int num, int ins, int del) {
+   int part[2][3]; // num, del, ins of the head and of head plus middle
+   int end[2] = {hunk_bytes / 2, num + del + ins - (hunk_bytes - hunk_bytes / 2)};
+   for(int k=0; k<2; k++) {
+      part[k][0] = tMin(end[k], num);
+      part[k][1] = tMin(end[k] - part[k][0], del);
+      part[k][2] = end[k] - part[k][0] - part[k][1];
+   }
+   putChange(diff, part[0][0], part[0][2], part[0][1]);
+   if(stopped) return;
+   
+   // the marker
+   int n1 = part[1][0] - part[0][0] + part[1][1] - part[0][1];
+   int n2 = part[1][0] - part[0][0] + part[1][2] - part[0][2];
+   char text[64];
+   if((n1 == n2) || (n1 == 0) || (n2 == 0)) sprintf(text, "... %d bytes ...", tMax(n1, n2));
+   else sprintf(text, "... %d : %d bytes ...", n1, n2);
+   if(mode == VERTICAL) {
+      if(n2 == 0)      print("0x%08X (%10d): %s%s%s\n", o1, o1, colorStr(diff), text, color_nor);
+      else if(n1 == 0) print("%25s%s%27s%s :(%10d) 0x%08X\n", "", colorStr(diff), text, color_nor, o2, o2);
+      else             print("0x%08X (%10d): %s%-27s%s :(%10d) 0x%08X\n", o1, o1, colorStr(diff), 
+			     text, color_nor, o2, o2);
+   } else {
+      flush();
+      *linebuf1 = *linebuf2 = 0;
+      if(n1) sprintf(linebuf1, "%08X: %s%s%s", o1, colorStr(diff), text, color_nor);
+      if(n2) sprintf(linebuf2, "%08X: %s%s%s", o2, colorStr(diff), text, color_nor);
+      printSplitLine(linebuf1, linebuf2);
+   }
+   if(line_numbers && (mode == F_ASCII)) {
+      for(int i=0; i<n1; i++) if(f1[o1+i] == '\n') line1++;
+      for(int i=0; i<n2; i++) if(f2[o2+i] == '\n') line2++;
+   }
+   o1 += n1;
+   o2 += n2;
+   
+   putChange(diff, num - part[1][0], ins - part[1][2], del - part[1][1]);
+}
+
+
+void TDiffOutput::putChange(DIFF_T diff, int num, int ins, int del) {
+   switch(diff) {
+    case SUB: putSub(num, ins, del); break;
+    case DEL: putDel(del); break;
+    case INS: putIns(ins); break;
+    default:
+      fatalError("internal error: diff=%d\n", diff);
+   }
 }
 
 
 void TDiffOutput::mat(int num) {
+   in_hunk = false;
+   if(stopped || hide_mat) {
+      if(!stopped && (mode != VERTICAL)) flush();
+      o1 += num;
+      o2 += num;
+      return;
+   }
+   if(range_mat) rangeMat(num);
+   else if(context >= 0) contextMat(num);
+   else putMat(num);
+}
+
+
+void TDiffOutput::rangeMat(int num) {
+   switch(mode) {
+    case VERTICAL:
+      print("0x%08X (%10d): %s%10d bytes match     %s :(%10d) 0x%08X\n", 
+	    o1, o1, color_mat, num, color_nor, o2, o2);
+      break;
+
+    case F_ASCII:
+    case U_ASCII:
+    case HEX:
+      flush();
+      sprintf(linebuf1, "%08X: %s%10d bytes match%s", o1, color_mat, num, 
+	      color_nor);
+      sprintf(linebuf2, "%08X: %s%10d bytes match%s", o2, color_mat, num, 
+	      color_nor);
+      printSplitLine(linebuf1, linebuf2);
+      break;
+   }
+   o1 += num;
+   o2 += num;
+}
+
+
+void TDiffOutput::putMat(int num) {
    int i;
    char buf1[10];
    char buf2[10];
    switch(mode) {
     case VERTICAL:
-      if(hide_mat) {
-	 o1 += num;
-	 o2 += num;
-	 return;
-      }
-      if(range_mat) {
-	 printf("0x%08X (%10d): %s%10d bytes match     %s :(%10d) 0x%08X\n", 
-		o1, o1, color_mat, num, color_nor, o2, o2);
-	 o1 += num;
-	 o2 += num;
-	 return;
-      }
-      for(i=0; i<num; i++, o1++, o2++) {
-	 printf("0x%08X (%10d): %s%s %3d 0x%02X   0x%02X %3d %s%s :(%10d) 0x%08X\n",
-		o1, o1, color_mat, printChar(f1[o1], buf1), f1[o1], f1[o1], 
-		f2[o2], f2[o2], printChar(f2[o2], buf2), color_nor, o2, o2);
+      for(i=0; (i<num) && !stopped; i++, o1++, o2++) {
+	 print("0x%08X (%10d): %s%s %3d 0x%02X   0x%02X %3d %s%s :(%10d) 0x%08X\n",
+	       o1, o1, color_mat, printChar(f1[o1], buf1), f1[o1], f1[o1], 
+	       f2[o2], f2[o2], printChar(f2[o2], buf2), color_nor, o2, o2);
       }
       break;
 
     case F_ASCII:
     case U_ASCII:
     case HEX:
-      if(hide_mat) {
-	 flush();
-	 o1 += num;
-	 o2 += num;
-	 return;
-      }
-      if(range_mat) {
-	 flush();
-	 sprintf(linebuf1, "%08X: %s%10d bytes match%s", o1, color_mat, num, 
-		 color_nor);
-	 sprintf(linebuf2, "%08X: %s%10d bytes match%s", o2, color_mat, num, 
-		 color_nor);
-	 printSplitLine(linebuf1, linebuf2);
-	 o1 += num;
-	 o2 += num;
-	 return;
-      }
-      for(i=0; i<num; i++, o1++, o2++) {
+      for(i=0; (i<num) && !stopped; i++, o1++, o2++) {
 	 if(mode==HEX) putHexElem(o1, f1[o1], o2, f2[o2], MAT);
 	 else          putAscElem(o1, f1[o1], o2, f2[o2], MAT, mode==F_ASCII);
       }
@@ -643,10 +760,51 @@ void TDiffOutput::mat(int num) {
 }
 
 
+// --context: print only the context bytes (lines in formatted mode) of a
+// match after and before a change, the rest as a range which is not read
+// (but for counting lines with --line-numbers)
+void TDiffOutput::contextMat(int num) {
+   int head = (o1 || o2) ? contextLen(o1, num, true) : 0;
+   int tail = ((o1 + num < f1.size()) || (o2 + num < f2.size())) ? 
+     contextLen(o1 + num, num, false) : 0;
+   if(head + tail >= num) {
+      putMat(num);
+      return;
+   }
+   putMat(head);
+   if(stopped) return;
+   int skip = num - head - tail;
+   if(line_numbers && (mode == F_ASCII)) {
+      // the same bytes in both files: the same number of lines
+      int lines = 0;
+      for(int i=0; i<skip; i++) if(f1[o1+i] == '\n') lines++;
+      line1 += lines;
+      line2 += lines;
+   }
+   rangeMat(skip);
+   putMat(tail);
+}
+
+
+// length of the context after (forward) or before offset o of file 1 in a
+// match of num bytes: context bytes, or in formatted mode the rest of the
+// changed line and context lines, each at most one output line long
+int TDiffOutput::contextLen(int o, int num, bool forward) {
+   if(mode != F_ASCII) return tMin(context, num);
+   int max = tMin(num, (context + 1) * bytes_per_line);
+   int lines = 0;
+   for(int i=0; i<max; i++) {
+      if(forward) {
+	 if((f1[o+i] == '\n') && (++lines > context)) return i + 1;
+      } else {
+	 if((f1[o-1-i] == '\n') && (++lines > context)) return i;
+      }
+   }
+   return max;
+}
+
+
 void TDiffOutput::sub(int num, int ins, int del) {
-   int i;
-   char buf1[10];
-   char buf2[10];
    switch(mode) {
     case VERTICAL:
       if(hide_sub) {
@@ -654,26 +812,14 @@ void TDiffOutput::sub(int num, int ins, int del) {
 	 o2 += num + ins;
 	 return;
       }
+      if(change(num + del, num + ins)) return;
       if(range_sub) {
-	 printf("0x%08X (%10d): %s%10d subst %10d%s :(%10d) 0x%08X\n",
-		o1, o1, color_sub, num + del, num + ins, color_nor, o2, o2);
+	 print("0x%08X (%10d): %s%10d subst %10d%s :(%10d) 0x%08X\n",
+	       o1, o1, color_sub, num + del, num + ins, color_nor, o2, o2);
 	 o1 += num + del;
 	 o2 += num + ins;
 	 return;
       }
-      for(i=0; i<num; i++, o1++, o2++) {
-	 printf("0x%08X (%10d): %s%s %3d 0x%02X ! 0x%02X %3d %s%s :(%10d) 0x%08X\n",
-		o1, o1, color_sub, printChar(f1[o1], buf1), f1[o1], f1[o1], 
-		f2[o2], f2[o2], printChar(f2[o2], buf2), color_nor, o2, o2);
-      }
-      for(i=0; i<del; i++, o1++) {
-	 printf("0x%08X (%10d): %s%s %3d 0x%02X !%s\n",
-		o1, o1, color_sub, printChar(f1[o1], buf1), f1[o1], f1[o1], color_nor);
-      }
-      for(i=0; i<ins; i++, o2++) {
-	 printf("                                      %s! 0x%02X %3d %s%s :(%10d) 0x%08X\n",
-		color_sub, f2[o2], f2[o2], printChar(f2[o2], buf1), color_nor, o2, o2);
-      }
       break;
 
     case F_ASCII:
@@ -685,6 +831,7 @@ void TDiffOutput::sub(int num, int ins, int del) {
 	 o2 += num + ins;
 	 return;
       }
+      if(change(num + del, num + ins)) return;
       if(range_sub) {
 	 flush();
 	 sprintf(linebuf1, "%08X: %s%10d bytes substituted%s", o1, color_sub, 
@@ -696,15 +843,46 @@ void TDiffOutput::sub(int num, int ins, int del) {
 	 o2 += num + ins;
 	 return;
       }
-      for(i=0; i<num; i++, o1++, o2++) {
+      break;
+   }
+   if(hunk_bytes && (num + del + ins > hunk_bytes)) elide(SUB, num, ins, del);
+   else putSub(num, ins, del);
+}
+
+
+void TDiffOutput::putSub(int num, int ins, int del) {
+   int i;
+   char buf1[10];
+   char buf2[10];
+   switch(mode) {
+    case VERTICAL:
+      for(i=0; (i<num) && !stopped; i++, o1++, o2++) {
+	 print("0x%08X (%10d): %s%s %3d 0x%02X ! 0x%02X %3d %s%s :(%10d) 0x%08X\n",
+	       o1, o1, color_sub, printChar(f1[o1], buf1), f1[o1], f1[o1], 
+	       f2[o2], f2[o2], printChar(f2[o2], buf2), color_nor, o2, o2);
+      }
+      for(i=0; (i<del) && !stopped; i++, o1++) {
+	 print("0x%08X (%10d): %s%s %3d 0x%02X !%s\n",
+	       o1, o1, color_sub, printChar(f1[o1], buf1), f1[o1], f1[o1], color_nor);
+      }
+      for(i=0; (i<ins) && !stopped; i++, o2++) {
+	 print("                                      %s! 0x%02X %3d %s%s :(%10d) 0x%08X\n",
+	       color_sub, f2[o2], f2[o2], printChar(f2[o2], buf1), color_nor, o2, o2);
+      }
+      break;
+
+    case F_ASCII:
+    case U_ASCII:
+    case HEX:
+      for(i=0; (i<num) && !stopped; i++, o1++, o2++) {
 	 if(mode==HEX) putHexElem(o1, f1[o1], o2, f2[o2], SUB);
 	 else          putAscElem(o1, f1[o1], o2, f2[o2], SUB, mode==F_ASCII);
       }
-      for(i=0; i<del; i++, o1++) {
+      for(i=0; (i<del) && !stopped; i++, o1++) {
 	 if(mode==HEX) putHexElem(o1, f1[o1], -1, 0, SUB);
 	 else          putAscElem(o1, f1[o1], -1, 0, SUB, mode==F_ASCII);
       }
-      for(i=0; i<ins; i++, o2++) {
+      for(i=0; (i<ins) && !stopped; i++, o2++) {
 	 if(mode==HEX) putHexElem(-1, 0, o2, f2[o2], SUB);
 	 else          putAscElem(-1, 0, o2, f2[o2], SUB, mode==F_ASCII);
       }
@@ -714,24 +892,19 @@ void TDiffOutput::sub(int num, int ins, int del) {
 
 
 void TDiffOutput::del(int num) {
-   int i;
-   char buf[10];
    switch(mode) {
     case VERTICAL:
       if(hide_del) {
 	 o1 += num;
 	 return;
       }
+      if(change(num, 0)) return;
       if(range_del) {
-	 printf("0x%08X (%10d): %s%10d bytes deleted   %s\n",
-		o1, o1, color_del, num, color_nor);
+	 print("0x%08X (%10d): %s%10d bytes deleted   %s\n",
+	       o1, o1, color_del, num, color_nor);
 	 o1 += num;
 	 return;
       }
-      for(i=0; i<num; i++, o1++) {
-	 printf("0x%08X (%10d): %s%s %3d 0x%02X <%s\n",
-		o1, o1, color_del, printChar(f1[o1], buf), f1[o1], f1[o1], color_nor);
-      }
       break;
 
     case F_ASCII:
@@ -742,6 +915,7 @@ void TDiffOutput::del(int num) {
 	 o1 += num;
 	 return;
       }
+      if(change(num, 0)) return;
       if(range_del) {
 	 flush();
 	 sprintf(linebuf1, "%08X: %s%10d bytes deleted%s", o1, color_del, 
@@ -751,7 +925,28 @@ void TDiffOutput::del(int num) {
 	 o1 += num;
 	 return;
       }
-      for(i=0; i<num; i++, o1++) {
+      break;
+   }
+   if(hunk_bytes && (num > hunk_bytes)) elide(DEL, 0, 0, num);
+   else putDel(num);
+}
+
+
+void TDiffOutput::putDel(int num) {
+   int i;
+   char buf[10];
+   switch(mode) {
+    case VERTICAL:
+      for(i=0; (i<num) && !stopped; i++, o1++) {
+	 print("0x%08X (%10d): %s%s %3d 0x%02X <%s\n",
+	       o1, o1, color_del, printChar(f1[o1], buf), f1[o1], f1[o1], color_nor);
+      }
+      break;
+
+    case F_ASCII:
+    case U_ASCII:
+    case HEX:
+      for(i=0; (i<num) && !stopped; i++, o1++) {
 	 if(mode==HEX) putHexElem(o1, f1[o1], -1, 0, DEL);
 	 else          putAscElem(o1, f1[o1], -1, 0, DEL, mode==F_ASCII);
       }
@@ -761,24 +956,19 @@ void TDiffOutput::del(int num) {
 
 
 void TDiffOutput::ins(int num) {
-   int i;
-   char buf[10];
    switch(mode) {
     case VERTICAL:
       if(hide_ins) {
 	 o2 += num;
 	 return;
       }
+      if(change(0, num)) return;
       if(range_ins) {
-	 printf("                         %s%10d bytes inserted  %s :(%10d) 0x%08X\n",
-		color_ins, num, color_nor, o2, o2);
+	 print("                         %s%10d bytes inserted  %s :(%10d) 0x%08X\n",
+	       color_ins, num, color_nor, o2, o2);
 	 o2 += num;
 	 return;
       }
-      for(i=0; i<num; i++, o2++) {
-	 printf("                                      %s> 0x%02X %3d %s%s :(%10d) 0x%08X\n",
-		color_ins, f2[o2], f2[o2], printChar(f2[o2], buf), color_nor, o2, o2);
-      }
       break;
 
     case F_ASCII:
@@ -789,6 +979,7 @@ void TDiffOutput::ins(int num) {
 	 o2 += num;
 	 return;
       }
+      if(change(0, num)) return;
       if(range_ins) {
 	 flush();
 	 sprintf(linebuf1, "%08X: %s%10d bytes inserted%s", o2, color_ins, 
@@ -798,7 +989,28 @@ void TDiffOutput::ins(int num) {
 	 o2 += num;
 	 return;
       }
-      for(i=0; i<num; i++, o2++) {
+      break;
+   }
+   if(hunk_bytes && (num > hunk_bytes)) elide(INS, 0, num, 0);
+   else putIns(num);
+}
+
+
+void TDiffOutput::putIns(int num) {
+   int i;
+   char buf[10];
+   switch(mode) {
+    case VERTICAL:
+      for(i=0; (i<num) && !stopped; i++, o2++) {
+	 print("                                      %s> 0x%02X %3d %s%s :(%10d) 0x%08X\n",
+	       color_ins, f2[o2], f2[o2], printChar(f2[o2], buf), color_nor, o2, o2);
+      }
+      break;
+
+    case F_ASCII:
+    case U_ASCII:
+    case HEX:
+      for(i=0; (i<num) && !stopped; i++, o2++) {
 	 if(mode==HEX) putHexElem(-1, 0, o2, f2[o2], INS);
 	 else          putAscElem(-1, 0, o2, f2[o2], INS, mode==F_ASCII);
       }
@@ -807,6 +1019,93 @@ void TDiffOutput::ins(int num) {
 }
 
 
+// a part of an index starts here: with --line-numbers the lines before
+// it are counted
+void TDiffOutput::seek(int off1, int off2) {
+   if(mode != VERTICAL) flush();
+   o1 = off1;
+   o2 = off2;
+   if(line_numbers && (mode == F_ASCII)) {
+      line1 = line2 = 1;
+      for(int i=0; i<o1; i++) if(f1[i] == '\n') line1++;
+      for(int i=0; i<o2; i++) if(f2[i] == '\n') line2++;
+   }
+}
+
+
+void TDiffOutput::degraded(const char *how) {
+   if(mode != VERTICAL) flush();
+   print("0x%08X (%10d): degraded alignment (%s) :(%10d) 0x%08X\n", 
+	 o1, o1, how, o2, o2);
+}
+
+
+// the line buffers are saved completely, the address may have been
+// written into them after their end pointer
+bool TDiffOutput::saveState(TSinkState& st) const {
+   st.put(tstring(modeName()));
+   st.put(o1);
+   st.put(o2);
+   st.put(bytesin1);
+   st.put(bytesin2);
+   st.put(lastcolor1);
+   st.put(lastcolor2);
+   st.put(needadr1);
+   st.put(needadr2);
+   st.put(line1);
+   st.put(line2);
+   st.put(linebuf1p - linebuf1);
+   st.put(linebuf2p - linebuf2);
+   st.put(tstring(linebuf1, half_line_len*16));
+   st.put(tstring(linebuf2, half_line_len*16));
+   st.put(hunks);
+   st.put(printed);
+   st.put(in_hunk);
+   st.put(stopped);
+   return true;
+}
+
+
+bool TDiffOutput::loadState(TSinkState& st) {
+   if(st.getStr() != modeName()) return false;
+   o1 = st.get();
+   o2 = st.get();
+   bytesin1 = st.get();
+   bytesin2 = st.get();
+   lastcolor1 = DIFF_T(st.get());
+   lastcolor2 = DIFF_T(st.get());
+   needadr1 = st.get();
+   needadr2 = st.get();
+   line1 = st.get();
+   line2 = st.get();
+   linebuf1p = linebuf1 + st.get();
+   linebuf2p = linebuf2 + st.get();
+   tstring b1 = st.getStr();
+   tstring b2 = st.getStr();
+   if((b1.len() != size_t(half_line_len*16)) || (b2.len() != size_t(half_line_len*16))) return false;
+   memcpy(linebuf1, b1.data(), b1.len());
+   memcpy(linebuf2, b2.data(), b2.len());
+   hunks = st.get();
+   printed = st.get();
+   in_hunk = st.get();
+   stopped = st.get();
+   return true;
+}
+
+
+const char *TDiffOutput::modeName() const {
+   // -R: every event is a byte range, whatever the mode
+   if(range_mat && range_sub && range_ins && range_del) return "range";
+   switch(mode) {
+    case VERTICAL: return "vertical";
+    case F_ASCII:  return "formatted-ascii";
+    case U_ASCII:  return "unformatted-ascii";
+    case HEX:      return "hex";
+   }
+   return "";
+}
+
+
 TDiffOutput::MODE_T TDiffOutput::autoMode() {
    int i;
    double newline=0;
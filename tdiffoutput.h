@@ -32,8 +32,9 @@
 #include "terror.h"
 #include "trotfile.h"
 #include "tappconfig.h"
+#include "tdiffsink.h"
 
-class TDiffOutput {
+class TDiffOutput: public TDiffSink {
  public:
    // ctor & dtor
    TDiffOutput(TROTFile& f1, TROTFile& f2, const TAppConfig& ac);
@@ -46,6 +47,13 @@ class TDiffOutput {
    void mat(int i); // match
    
    void flush();    // flush buffers: assume no more output   
+   void degraded(const char *how);
+   bool saveState(TSinkState& st) const;
+   bool loadState(TSinkState& st);
+   bool full() const {return stopped;}
+   void seek(int off1, int off2);
+   
+   const char *modeName() const; // output mode, for --profile
    
  private:  // private data
    TROTFile& f1;    // file data
@@ -92,10 +100,32 @@ class TDiffOutput {
    char unprint;
    bool control_hex;
    
+   // output limits (0: none) and what was printed so far
+   int max_hunks;
+   int max_output;
+   int hunk_bytes;
+   int context;     // --context, -1: print all of a match
+   int hunks;
+   long long printed;
+   bool in_hunk;
+   bool stopped;
+   
    // private methods
    MODE_T autoMode();
    void setStrLen(char *str, int len) const;
-   void printSplitLine(char *abuf1, char *abuf2) const;
+   void printSplitLine(char *abuf1, char *abuf2);
+   void print(const char *format, ...);
+   bool change(int n1, int n2);
+   void stop(const char *why);
+   void elide(DIFF_T diff, int num, int ins, int del);
+   void putChange(DIFF_T diff, int num, int ins, int del);
+   void rangeMat(int num);
+   void putMat(int num);
+   void contextMat(int num);
+   int contextLen(int o, int num, bool forward);
+   void putSub(int num, int ins, int del);
+   void putDel(int num);
+   void putIns(int num);
    void putHexElem(int o1, uchar b1, int o2, uchar b2, DIFF_T diff);
    void putAscElem(int o1, uchar b1, int o2, uchar b2, DIFF_T diff, bool formatted);
    const char *colorStr(DIFF_T diff) const;
@@ -0,0 +1,107 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tdiffsink_h_
+#define _tdiffsink_h_
+
+#include "tvector.h"
+#include "tstring.h"
+
+// saved state of a sink (see TCheckpoint): numbers and strings, read back
+// in the order they were put
+class TSinkState {
+ public:
+   TSinkState(): n(0), s(0) {}
+   void put(long long v) {num += v;}
+   void put(const tstring& v) {str += v;}
+   long long get() {return (n < num.size()) ? num[n++] : 0;}
+   tstring getStr() {return (s < str.size()) ? str[s++] : tstring();}
+   bool complete() const {return (n == num.size()) && (s == str.size());}
+   
+   tvector<long long> num;
+   tvector<tstring> str;
+ private:
+   size_t n;
+   size_t s;
+};
+
+
+// receiver of the edit script generated by diff() (see tdiffengine.h)
+class TDiffSink {
+ public:
+   virtual ~TDiffSink() {}
+   
+   // interface
+   virtual void ins(int i) = 0; // insertion 
+   virtual void del(int i) = 0; // deletion
+   virtual void sub(int i, int ins=0, int del=0) = 0; // substitution
+   virtual void mat(int i) = 0; // match
+   
+   virtual void flush() = 0;    // flush buffers: assume no more output   
+   
+   // the following events come from a degraded resync (see TSyncBudget)
+   virtual void degraded(const char *) {}
+   
+   // checkpoint: save/restore everything not printed yet, false if the
+   // sink can't be resumed
+   virtual bool saveState(TSinkState&) const {return false;}
+   virtual bool loadState(TSinkState&) {return false;}
+   
+   // the sink prints nothing more (output limits reached): stop the diff
+   virtual bool full() const {return false;}
+   
+   // the events continue at o1/o2 (a part of an index, see TDiffIndex)
+   virtual void seek(int, int) {}
+};
+
+
+// sink which passes the edit script to two sinks
+class TDiffTee: public TDiffSink {
+ public:
+   // with follow sink2 only records what sink1 prints (an index): the diff
+   // stops when sink1 is full, else only when both are
+   TDiffTee(TDiffSink& sink1, TDiffSink& sink2, bool follow = false): 
+   s1(sink1), s2(sink2), follows(follow) {}
+   
+   // interface
+   void ins(int i) {s1.ins(i); s2.ins(i);}
+   void del(int i) {s1.del(i); s2.del(i);}
+   void sub(int i, int ins=0, int del=0) {s1.sub(i, ins, del); s2.sub(i, ins, del);}
+   void mat(int i) {s1.mat(i); s2.mat(i);}
+   
+   void flush() {s1.flush(); s2.flush();}
+   void degraded(const char *how) {s1.degraded(how); s2.degraded(how);}
+   bool saveState(TSinkState& st) const {return s1.saveState(st) && s2.saveState(st);}
+   bool loadState(TSinkState& st) {return s1.loadState(st) && s2.loadState(st);}
+   bool full() const {return s1.full() && (follows || s2.full());}
+   void seek(int o1, int o2) {s1.seek(o1, o2); s2.seek(o1, o2);}
+   
+ private:
+   TDiffSink& s1;
+   TDiffSink& s2;
+   bool follows;
+   
+   // forbid copy
+   TDiffTee(const TDiffTee&);   
+   const TDiffTee& operator= (const TDiffTee&);
+};
+
+#endif
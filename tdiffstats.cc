@@ -0,0 +1,210 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include "tdiffstats.h"
+#include "tjson.h"
+#include "terror.h"
+#include "tminmax.h"
+
+
+static const char *className[] = {"match", "substitution", "deletion", "insertion"};
+
+
+// entries of the density vector for size bytes: the sizes come from
+// TROTFile, which refuses files over 2GB, so a negative one is a bug
+static long long densityBlocks(int fsize1, int fsize2, int blocksize) {
+   if((fsize1 < 0) || (fsize2 < 0) || (blocksize <= 0))
+     fatalError("invalid sizes %d/%d or block size %d!\n", fsize1, fsize2, blocksize);
+   return (fsize2 + (long long)blocksize - 1) / blocksize + 1;
+}
+
+
+TDiffStats::TDiffStats(const char *fname1, int fsize1, const char *fname2, 
+		       int fsize2, int block_size):
+name1(fname1), name2(fname2), size1(fsize1), size2(fsize2), o2(0), 
+blocksize(block_size), density(densityBlocks(fsize1, fsize2, block_size), 0),
+ndegraded(0)
+{
+   for(int c=0; c<NUM_CLASSES; c++) {
+      bytes1[c] = bytes2[c] = nruns[c] = 0;
+      for(int k=0; k<HIST_BUCKETS; k++) hist[c][k] = 0;
+   }
+}
+
+
+void TDiffStats::addRun(CLASS_T c, int len1, int len2) {
+   int len = tMax(len1, len2);
+   int k;
+   for(k=0; (len >> (k+1)) && (k < HIST_BUCKETS-1); k++) ;
+   bytes1[c] += len1;
+   bytes2[c] += len2;
+   nruns[c]++;
+   hist[c][k]++;
+}
+
+
+// account len changed bytes starting at the current offset in file 2
+void TDiffStats::addChange(int len) {
+   int off = o2;
+   if(len == 0) { // deletion: attribute to the current block
+      density[tMin(off, size2 - 1) / blocksize]++;
+      return;
+   }
+   while(len > 0) {
+      int b = off / blocksize;
+      int n = int(tMin((long long)len, (b + 1LL) * blocksize - off));
+      density[b] += n;
+      off += n;
+      len -= n;
+   }
+}
+
+
+void TDiffStats::mat(int num) {
+   addRun(MAT, num, num);
+   o2 += num;
+}
+
+
+void TDiffStats::sub(int num, int ins, int del) {
+   addRun(SUB, num + del, num + ins);
+   addChange(num + ins);
+   o2 += num + ins;
+}
+
+
+void TDiffStats::del(int num) {
+   addRun(DEL, num, 0);
+   if(num > 0) addChange(0);
+}
+
+
+void TDiffStats::ins(int num) {
+   addRun(INS, 0, num);
+   addChange(num);
+   o2 += num;
+}
+
+
+bool TDiffStats::saveState(TSinkState& st) const {
+   st.put(o2);
+   st.put(ndegraded);
+   for(int c=0; c<NUM_CLASSES; c++) {
+      st.put(bytes1[c]);
+      st.put(bytes2[c]);
+      st.put(nruns[c]);
+      for(int k=0; k<HIST_BUCKETS; k++) st.put(hist[c][k]);
+   }
+   st.put(density.size());
+   for(size_t b=0; b<density.size(); b++) st.put(density[b]);
+   return true;
+}
+
+
+bool TDiffStats::loadState(TSinkState& st) {
+   o2 = st.get();
+   ndegraded = st.get();
+   for(int c=0; c<NUM_CLASSES; c++) {
+      bytes1[c] = st.get();
+      bytes2[c] = st.get();
+      nruns[c] = st.get();
+      for(int k=0; k<HIST_BUCKETS; k++) hist[c][k] = st.get();
+   }
+   if(st.get() != (long long)density.size()) return false;
+   for(size_t b=0; b<density.size(); b++) density[b] = st.get();
+   return true;
+}
+
+
+// '.' unchanged, '0'..'9' changed fraction in [0..10%[ .. [90..100%[, 
+// '#' completely changed
+char TDiffStats::densityChar(int block) const {
+   long long changed = density[block];
+   long long len = tMin((long long)blocksize, size2 - (long long)block * blocksize);
+   if(changed == 0) return '.';
+   if(changed >= len) return '#';
+   return '0' + int((changed * 10) / len);
+}
+
+
+void TDiffStats::print(FILE *f, bool json) const {
+   if(json) printJSON(f);
+   else     printText(f);
+}
+
+
+void TDiffStats::printText(FILE *f) const {
+   int c, k;
+   fprintf(f, "file1: %s (%d bytes)\n", name1, size1);
+   fprintf(f, "file2: %s (%d bytes)\n", name2, size2);
+   fprintf(f, "\n%-14s %12s %12s %10s\n", "", "bytes1", "bytes2", "runs");
+   for(c=0; c<NUM_CLASSES; c++)
+     fprintf(f, "%-14s %12lld %12lld %10lld\n", className[c], bytes1[c], bytes2[c], nruns[c]);
+   fprintf(f, "changed: %.2f%% of file1, %.2f%% of file2\n",
+	   size1 ? 100.0 * changed1() / size1 : 0.0,
+	   size2 ? 100.0 * changed2() / size2 : 0.0);
+   if(ndegraded) 
+     fprintf(f, "degraded alignment: %lld resyncs (--sync-time/--sync-work budget or --max-shift exceeded)\n", ndegraded);
+   
+   // histogram: only non empty buckets
+   fprintf(f, "\nrun length histogram:\n%-23s %10s %12s %10s %10s\n", "length", 
+	   className[MAT], className[SUB], className[DEL], className[INS]);
+   for(k=0; k<HIST_BUCKETS; k++) {
+      if((hist[MAT][k] | hist[SUB][k] | hist[DEL][k] | hist[INS][k]) == 0) continue;
+      char range[32];
+      if(k == 0) sprintf(range, "1");
+      else       sprintf(range, "%u-%u", 1u << k, (2u << k) - 1);
+      fprintf(f, "%-23s %10lld %12lld %10lld %10lld\n", range, 
+	      hist[MAT][k], hist[SUB][k], hist[DEL][k], hist[INS][k]);
+   }
+   
+   // density map: 64 blocks per line
+   int nblocks = int((size2 + (long long)blocksize - 1) / blocksize);
+   fprintf(f, "\nchange density per %dMB of file2 ('.' unchanged, '0'-'9' <10%%-<100%%, '#' all changed):\n", 
+	   blocksize >> 20);
+   for(int b=0; b<nblocks; b++) {
+      if((b & 63) == 0) fprintf(f, "%s%08llX: ", b?"\n":"", (long long)b * blocksize);
+      fputc(densityChar(b), f);
+   }
+   fprintf(f, "\n");
+}
+
+
+void TDiffStats::printJSON(FILE *f) const {
+   int c, k;
+   fprintf(f, "{\n  \"file1\": {\"name\": ");
+   printJSONString(f, name1);
+   fprintf(f, ", \"size\": %d},\n  \"file2\": {\"name\": ", size1);
+   printJSONString(f, name2);
+   fprintf(f, ", \"size\": %d},\n  \"degraded_resyncs\": %lld,\n", size2, ndegraded);
+   for(c=0; c<NUM_CLASSES; c++) {
+      fprintf(f, "  \"%s\": {\"bytes1\": %lld, \"bytes2\": %lld, \"runs\": %lld, \"histogram\": [", 
+	      className[c], bytes1[c], bytes2[c], nruns[c]);
+      int last;
+      for(last=HIST_BUCKETS-1; (last>0) && (hist[c][last]==0); last--) ;
+      for(k=0; k<=last; k++) fprintf(f, "%s%lld", k?", ":"", hist[c][k]);
+      fprintf(f, "]},\n");
+   }
+   int nblocks = int((size2 + (long long)blocksize - 1) / blocksize);
+   fprintf(f, "  \"density_block_size\": %d,\n  \"density\": [", blocksize);
+   for(int b=0; b<nblocks; b++) fprintf(f, "%s%lld", b?", ":"", density[b]);
+   fprintf(f, "]\n}\n");
+}
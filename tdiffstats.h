@@ -0,0 +1,88 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tdiffstats_h_
+#define _tdiffstats_h_
+
+#include <stdio.h>
+#include "tdiffsink.h"
+#include "tvector.h"
+
+// diff sink which only counts: bytes and runs per class, a run length 
+// histogram and the change density per block of file 2
+class TDiffStats: public TDiffSink {
+ public:
+   // ctor & dtor
+   TDiffStats(const char *name1, int size1, const char *name2, int size2, 
+	      int blocksize);
+   ~TDiffStats() {}
+   
+   // interface
+   void ins(int i); // insertion 
+   void del(int i); // deletion
+   void sub(int i, int ins=0, int del=0); // substitution
+   void mat(int i); // match
+   
+   void flush() {}
+   void degraded(const char *) {ndegraded++;}
+   void seek(int, int off2) {o2 = off2;}
+   bool saveState(TSinkState& st) const;
+   bool loadState(TSinkState& st);
+   
+   // report
+   void print(FILE *f, bool json) const;
+   
+   // access
+   long long matched() const {return bytes1[MAT];}
+   long long changed1() const {return bytes1[SUB] + bytes1[DEL];}
+   long long changed2() const {return bytes2[SUB] + bytes2[INS];}
+   long long runs() const {return nruns[SUB] + nruns[DEL] + nruns[INS];}
+   
+ private:  // private data
+   enum CLASS_T {MAT, SUB, DEL, INS, NUM_CLASSES};
+   enum {HIST_BUCKETS = 32}; // bucket k: run lengths [2^k..2^(k+1)-1]
+   
+   const char *name1;
+   const char *name2;
+   int size1;
+   int size2;
+   int o2;                   // current offset in file 2
+   int blocksize;            // density block size
+   long long bytes1[NUM_CLASSES];
+   long long bytes2[NUM_CLASSES];
+   long long nruns[NUM_CLASSES];
+   long long hist[NUM_CLASSES][HIST_BUCKETS];
+   tvector<long long> density; // changed bytes per block of file 2
+   long long ndegraded;      // resyncs with degraded alignment
+   
+   // private methods
+   void addRun(CLASS_T c, int len1, int len2);
+   void addChange(int len);
+   void printText(FILE *f) const;
+   void printJSON(FILE *f) const;
+   char densityChar(int block) const;
+   
+   // forbid copy
+   TDiffStats(const TDiffStats&);   
+   const TDiffStats& operator= (const TDiffStats&);
+};
+
+#endif
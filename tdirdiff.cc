@@ -0,0 +1,241 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <limits.h>
+#include <unistd.h>
+#include "tdirdiff.h"
+#include "tdiffengine.h"
+#include "tdiffstats.h"
+#include "tdecompress.h"
+#include "tfilecmp.h"
+#include "tjson.h"
+#include "tminmax.h"
+
+
+// result of a job (in shared memory)
+struct TDirResult {
+   int same;     // contents are identical
+   int summary;  // diff summary below is valid
+   long long matched;
+   long long changed1;
+   long long changed2;
+   long long runs;
+};
+
+
+TDirDiff::TDirDiff(const TAppConfig& appconf, int num_buf, int buf_size):
+TJobPool(sizeof(TDirResult)), ac(appconf), numbuf(num_buf), bufsize(buf_size), 
+quiet(appconf("quiet")), dir1(appconf.param(0)), dir2(appconf.param(1)),
+path(), state(), size1(), size2(), pairjob(), jobpair()
+{
+   dir1.removeDirSlash();
+   dir2.removeDirSlash();
+}
+
+
+const char *TDirDiff::stateStr(int st) {
+   switch(st) {
+    case SAME:    return "same";
+    case CHANGED: return "changed";
+    case ADDED:   return "added";
+    case REMOVED: return "removed";
+    case SKIPPED: return "skipped";
+    case FAILED:  return "failed";
+    default:
+      fatalError("internal error: state=%d\n", st);
+   }
+}
+
+
+static tstring linkTarget(const tstring& name) {
+   char buf[PATH_MAX + 1];
+   int n = readlink(name.data(), buf, PATH_MAX);
+   if(n < 0) return tstring();
+   buf[n] = 0;
+   return tstring(buf);
+}
+
+
+// all files below dir, by relative path
+void TDirDiff::scan(const tstring& dir, tmap<tstring,TFile>& files) const {
+   try {
+      TSubTreeContext context(true);
+      TDir root(dir, context);
+      if(!root.isdir()) userError("'%s' is not a directory!\n", dir.data());
+      tvector<tstring> list = findFilesRecursive(root);
+      for(size_t i = 0; i < list.size(); i++) 
+	files[list[i].substr(dir.len() + 1)] = TFile(list[i]);
+   }
+   catch(const TException& e) {
+      userError("%s\n", e.message());
+   }
+}
+
+
+// pair files, decide what can be decided from stat() alone
+void TDirDiff::pair() {
+   tmap<tstring,TFile> files1, files2;
+   scan(dir1, files1);
+   scan(dir2, files2);
+   
+   // union of both, sorted by path
+   tmap<tstring,int> all;
+   tmap<tstring,TFile>::const_iterator it;
+   for(it = files1.begin(); it != files1.end(); ++it) all[it->first] = 1;
+   for(it = files2.begin(); it != files2.end(); ++it) all[it->first] = 1;
+   
+   for(tmap<tstring,int>::const_iterator a = all.begin(); a != all.end(); ++a) {
+      const tstring& p = a->first;
+      int st;
+      double s1 = 0, s2 = 0;
+      int job = -1;
+      if(!files2.contains(p)) {
+	 st = REMOVED;
+	 s1 = files1[p].size();
+      } else if(!files1.contains(p)) {
+	 st = ADDED;
+	 s2 = files2[p].size();
+      } else {
+	 const TFile& f1 = files1[p];
+	 const TFile& f2 = files2[p];
+	 s1 = f1.size();
+	 s2 = f2.size();
+	 if(f1.issymlink() && f2.issymlink()) {
+	    st = (linkTarget(f1.name()) == linkTarget(f2.name())) ? SAME : CHANGED;
+	 } else if(!f1.isregular() || !f2.isregular()) {
+	    // special files are not read
+	    st = (f1.filetype() == f2.filetype()) ? SKIPPED : CHANGED;
+	 } else if(f1.instance() == f2.instance()) {
+	    st = SAME; // hardlinked or the same tree
+	 } else if((s1 != s2) && quiet && !TDecompressor::enabled) {
+	    // (compressed files of different sizes may decode to the same data)
+	    st = CHANGED;
+	 } else {
+	    st = CHANGED; // until the job tells otherwise
+	    job = jobpair.size();
+	    jobpair += int(path.size());
+	 }
+      }
+      path += p;
+      state += st;
+      size1 += s1;
+      size2 += s2;
+      pairjob += job;
+   }
+}
+
+
+int TDirDiff::job(int i, void *result) {
+   TDirResult *r = (TDirResult *)result;
+   int p = jobpair[i];
+   tstring name1 = dir1 + "/" + path[p];
+   tstring name2 = dir2 + "/" + path[p];
+   
+   int c = quickCompare(name1.data(), name2.data());
+   if(c == QC_TROUBLE) return 2;
+   if(c == QC_SAME) {
+      r->same = 1;
+      return 0;
+   }
+   if(quiet) return 0;
+   
+   // diff summary, only for files the engine can handle
+   if((size1[p] > INT_MAX) || (size2[p] > INT_MAX)) return 0;
+   TROTFile f1(name1.data(), numbuf, bufsize);
+   TROTFile f2(name2.data(), numbuf, bufsize);
+   TDiffStats stats(f1.name(), f1.size(), f2.name(), f2.size(), ac.getInt("stats-block") << 20);
+   diff(f1, f2, stats, ac);
+   r->summary = 1;
+   r->matched = stats.matched();
+   r->changed1 = stats.changed1();
+   r->changed2 = stats.changed2();
+   r->runs = stats.runs();
+   return 0;
+}
+
+
+void TDirDiff::report() const {
+   bool json = ac("json");
+   bool verbose = ac("verbose");
+   bool first = true;
+   
+   if(json) {
+      printf("{\n  \"dir1\": ");
+      printJSONString(stdout, dir1.data());
+      printf(",\n  \"dir2\": ");
+      printJSONString(stdout, dir2.data());
+      printf(",\n  \"files\": [\n");
+   }
+   for(size_t p = 0; p < path.size(); p++) {
+      int st = state[p];
+      const TDirResult *r = (pairjob[p] >= 0) ? (const TDirResult *)result(pairjob[p]) : 0;
+      if(((st == SAME) || (st == SKIPPED)) && !verbose) continue;
+      if(json) {
+	 printf("%s    {\"path\": ", first?"":",\n");
+	 printJSONString(stdout, path[p].data());
+	 printf(", \"state\": \"%s\", \"size1\": %.0f, \"size2\": %.0f", stateStr(st), size1[p], size2[p]);
+	 if(r && r->summary) 
+	   printf(", \"matched\": %lld, \"changed1\": %lld, \"changed2\": %lld, \"runs\": %lld",
+		  r->matched, r->changed1, r->changed2, r->runs);
+	 printf("}");
+      } else {
+	 printf("%-8s %s", stateStr(st), path[p].data());
+	 if((st == CHANGED) && r && r->summary) {
+	    double m = tMax(size1[p], size2[p]);
+	    printf(" (%.0f -> %.0f bytes, %.2f%% match, %lld runs, %lld/%lld bytes changed)",
+		   size1[p], size2[p], m ? 100.0 * r->matched / m : 100.0, 
+		   r->runs, r->changed1, r->changed2);
+	 } else if(st == CHANGED) {
+	    printf(" (%.0f -> %.0f bytes)", size1[p], size2[p]);
+	 }
+	 printf("\n");
+      }
+      first = false;
+   }
+   if(json) printf("%s  ]\n}\n", first?"":"\n");
+}
+
+
+int TDirDiff::compare() {
+   pair();
+   
+   // largest files first
+   tvector<double> jobsize;
+   for(size_t i = 0; i < jobpair.size(); i++) 
+     jobsize += tMax(size1[jobpair[i]], size2[jobpair[i]]);
+   int jobs = ac.getInt("jobs");
+   if(jobs == 0) jobs = numCPUs();
+   run(jobpair.size(), jobs, largestFirst(jobsize));
+   
+   // collect
+   int r = 0;
+   for(size_t p = 0; p < path.size(); p++) {
+      if(pairjob[p] >= 0) {
+	 int status = exitStatus(pairjob[p]);
+	 if(status) state[p] = FAILED;
+	 else if(((const TDirResult *)result(pairjob[p]))->same) state[p] = SAME;
+      }
+      if(state[p] == FAILED) r = 2;
+      else if((state[p] != SAME) && (state[p] != SKIPPED) && (r == 0)) r = 1;
+   }
+   if(!quiet) report();
+   return r;
+}
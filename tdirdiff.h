@@ -0,0 +1,72 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tdirdiff_h_
+#define _tdirdiff_h_
+
+#include "tjobpool.h"
+#include "tappconfig.h"
+#include "tfiletools.h"
+
+// compare two directory trees: files are paired by relative path,
+// pairs which are not obviously equal are compared (and diffed for a
+// summary) in parallel
+class TDirDiff: public TJobPool {
+ public:
+   // ctor & dtor
+   TDirDiff(const TAppConfig& ac, int numbuf, int bufsize);
+   ~TDirDiff() {}
+   
+   // compare and print report, return exit status (0 same, 1 differ, 2 trouble)
+   int compare();
+   
+ protected:
+   int job(int i, void *result);
+   
+ private:
+   enum STATE_T {SAME, CHANGED, ADDED, REMOVED, SKIPPED, FAILED};
+   
+   // private data
+   const TAppConfig& ac;
+   int numbuf;
+   int bufsize;
+   bool quiet;
+   tstring dir1;
+   tstring dir2;
+   tvector<tstring> path;    // relative path of pair
+   tvector<int> state;       // STATE_T of pair
+   tvector<double> size1;
+   tvector<double> size2;
+   tvector<int> pairjob;     // job of pair or -1
+   tvector<int> jobpair;     // pair of job
+   
+   // private methods
+   void scan(const tstring& dir, tmap<tstring,TFile>& files) const;
+   void pair();
+   void report() const;
+   static const char *stateStr(int state);
+   
+   // forbid copy
+   TDirDiff(const TDirDiff&);
+   const TDirDiff& operator=(const TDirDiff&);
+};
+
+#endif
@@ -0,0 +1,197 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+#include "textents.h"
+#include "tminmax.h"
+
+
+bool TExtentMap::enabled = true;
+TExtentMap::METHOD_T TExtentMap::method = TExtentMap::SEEK;
+bool TExtentMap::reflinks = true;
+
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+#define QDIFF_FIEMAP
+// FIEMAP flags which make the physical offset meaningless for comparison
+static const uint unlocated = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC |
+  FIEMAP_EXTENT_ENCODED | FIEMAP_EXTENT_DATA_ENCRYPTED | 
+  FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_DATA_TAIL;
+#endif
+
+
+bool TExtentMap::load(int fd, off_t size, METHOD_T how) {
+   _size = size;
+   start.clear();
+   end.clear();
+   phys.clear();
+   last = 0;
+   bool ok = (how == FIEMAP) ? loadFiemap(fd) : loadSeek(fd);
+   if(!ok) {
+      start.clear();
+      end.clear();
+      phys.clear();
+      if(size) add(0, size);
+   }
+   if(!enabled) {
+      // --no-holes: holes count as data at an unknown place
+      tvector<off_t> s0(start), e0(end), p0(phys);
+      start.clear();
+      end.clear();
+      phys.clear();
+      off_t o = 0;
+      for(size_t k=0; k<s0.size(); k++) {
+	 add(o, s0[k]);
+	 add(s0[k], e0[k], p0[k]);
+	 o = e0[k];
+      }
+      add(o, size);
+   }
+   off_t data = 0;
+   located = false;
+   for(size_t k=0; k<start.size(); k++) {
+      data += end[k] - start[k];
+      if(phys[k] >= 0) located = true;
+   }
+   holes = data < size;
+   return ok;
+}
+
+
+// append an extent, merging it with the previous one if they touch (and 
+// are contiguous on the device)
+void TExtentMap::add(off_t s, off_t e, off_t p) {
+   e = tMin(e, _size);
+   if(s >= e) return;
+   int n = start.size();
+   bool contiguous = n && ((phys[n-1] < 0) ? (p < 0) : (p == phys[n-1] + (s - start[n-1])));
+   if(n && (s <= end[n-1]) && contiguous) {
+      if(e > end[n-1]) end[n-1] = e;
+   } else {
+      start += s;
+      end += e;
+      phys += p;
+   }
+}
+
+
+bool TExtentMap::loadSeek(int fd) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+   off_t off = 0;
+   while(off < _size) {
+      off_t d = lseek(fd, off, SEEK_DATA);
+      if(d < 0) {
+	 if(errno == ENXIO) break; // only a hole up to the end
+	 return false;
+      }
+      off_t h = lseek(fd, d, SEEK_HOLE);
+      if(h < 0) return false;
+      add(d, h);
+      off = h;
+   }
+   return true;
+#else
+   return false;
+#endif
+}
+
+
+// unwritten (preallocated) extents read as zero, they count as holes;
+// without FIEMAP (not Linux) the extents come from SEEK_DATA/SEEK_HOLE,
+// without locations
+bool TExtentMap::loadFiemap(int fd) {
+#ifndef QDIFF_FIEMAP
+   return loadSeek(fd);
+#else
+   const int num = 256;
+   char *mem = new char[sizeof(struct fiemap) + num * sizeof(struct fiemap_extent)];
+   struct fiemap *fm = (struct fiemap *)mem;
+   off_t off = 0;
+   bool ok = true;
+   for(bool done = false; !done && (off < _size); ) {
+      memset(fm, 0, sizeof(struct fiemap));
+      fm->fm_start = off;
+      fm->fm_length = _size - off;
+      fm->fm_flags = FIEMAP_FLAG_SYNC;
+      fm->fm_extent_count = num;
+      if(ioctl(fd, FS_IOC_FIEMAP, fm) < 0) {
+	 ok = false;
+	 break;
+      }
+      if(fm->fm_mapped_extents == 0) break;
+      for(uint k=0; k<fm->fm_mapped_extents; k++) {
+	 struct fiemap_extent& e = fm->fm_extents[k];
+	 if(!(e.fe_flags & FIEMAP_EXTENT_UNWRITTEN))
+	   add(e.fe_logical, e.fe_logical + e.fe_length, 
+	       (e.fe_flags & unlocated) ? -1 : off_t(e.fe_physical));
+	 off = e.fe_logical + e.fe_length;
+	 if(e.fe_flags & FIEMAP_EXTENT_LAST) done = true;
+      }
+   }
+   delete[] mem;
+   return ok;
+#endif
+}
+
+
+// index of the first extent ending after i, numExtents() if none
+int TExtentMap::find(off_t i) const {
+   int n = start.size();
+   if((last < n) && (end[last] > i) && ((last == 0) || (end[last-1] <= i))) return last;
+   if((last+1 < n) && (end[last+1] > i) && (end[last] <= i)) return ++last;
+   int lo = 0, hi = n;
+   while(lo < hi) {
+      int mid = (lo+hi)/2;
+      if(end[mid] > i) hi = mid; else lo = mid+1;
+   }
+   if(lo < n) last = lo;
+   return lo;
+}
+
+
+off_t TExtentMap::holeLen(off_t i) const {
+   if(!holes || (i >= _size)) return 0;
+   int k = find(i);
+   if(k == int(start.size())) return _size - i;
+   return (start[k] > i) ? start[k] - i : 0;
+}
+
+
+off_t TExtentMap::dataLen(off_t i) const {
+   int k = find(i);
+   if((k == int(start.size())) || (start[k] > i)) return 0;
+   return end[k] - i;
+}
+
+
+off_t TExtentMap::location(off_t i, off_t& len) const {
+   if(!located) return -1;
+   int k = find(i);
+   if((k == int(start.size())) || (start[k] > i) || (phys[k] < 0)) return -1;
+   len = end[k] - i;
+   return phys[k] + (i - start[k]);
+}
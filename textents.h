@@ -0,0 +1,73 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _textents_h_
+#define _textents_h_
+
+#include <sys/types.h>
+#include "tvector.h"
+
+// the data extents of a file as told by the filesystem, everything else 
+// is a hole and reads as zero, FIEMAP also tells where the data is on the
+// device: extents at the same place in two files of one filesystem are
+// shared (reflink copies, hard links) and hold the same data
+class TExtentMap {
+ public:
+   enum METHOD_T {SEEK, FIEMAP};
+   
+   TExtentMap(): _size(0), last(0), holes(false), located(false) {}
+   
+   // query the extents of the open file fd of the given size, false if 
+   // the filesystem can't tell (the map then holds one data extent)
+   bool load(int fd, off_t size, METHOD_T how);
+   
+   // settings, see --no-holes, --fiemap and --no-reflinks
+   static bool enabled;
+   static METHOD_T method;
+   static bool reflinks;
+   
+   // access
+   bool hasHoles() const {return holes;}
+   bool hasLocations() const {return located;}
+   int numExtents() const {return start.size();}
+   off_t holeLen(off_t i) const; // length of the hole at i, 0 in data
+   off_t dataLen(off_t i) const; // length of the data at i, 0 in a hole
+   // device offset of the data at i and the contiguous length there in 
+   // len, -1 if unknown (holes, SEEK, inline, compressed or delayed data)
+   off_t location(off_t i, off_t& len) const;
+   
+ private:
+   off_t _size;
+   tvector<off_t> start;  // data extents [start, end), sorted
+   tvector<off_t> end;
+   tvector<off_t> phys;   // device offset of start or -1
+   mutable int last;      // extent of the last lookup
+   bool holes;
+   bool located;          // some extent has a device offset
+   
+   // private methods
+   int find(off_t i) const;
+   void add(off_t s, off_t e, off_t p = -1);
+   bool loadSeek(int fd);
+   bool loadFiemap(int fd);
+};
+
+#endif
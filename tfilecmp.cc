@@ -0,0 +1,237 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "tfilecmp.h"
+#include "trotfile.h"
+#include "tdecompress.h"
+#include "terror.h"
+#include "ttypes.h"
+
+
+static const off_t mapChunk  = 64*1024*1024; // bytes mapped at once
+static const int   readChunk = 1024*1024;    // bytes read at once
+static const int   notCompressed = -1;       // compareDecoded(): compare as stored
+static const int   corruptData = -2;         // fill(): decode error
+
+
+// read up to len bytes, return number of bytes read or -1 on error, 
+// with TROTFile::IO_DROP the pages read are dropped from the cache
+static int readFull(int fd, uchar *buf, int len) {
+   int n = 0;
+   while(n < len) {
+      int r = read(fd, buf + n, len - n);
+      if(r < 0) return -1;
+      if(r == 0) break;
+      n += r;
+   }
+   if((TROTFile::io == TROTFile::IO_DROP) && (n > 0)) {
+      off_t pos = lseek(fd, 0, SEEK_CUR);
+      posix_fadvise(fd, pos - n, n, POSIX_FADV_DONTNEED);
+   }
+   return n;
+}
+
+
+// open for reading, with O_DIRECT in TROTFile::IO_DIRECT mode if possible
+static int openRead(const char *fname) {
+   if(TROTFile::io == TROTFile::IO_DIRECT) {
+      int fd = open(fname, O_RDONLY | O_DIRECT);
+      if(fd >= 0) return fd;
+   }
+   int fd = open(fname, O_RDONLY);
+   if((fd >= 0) && (TROTFile::io == TROTFile::IO_DROP)) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+   }
+   return fd;
+}
+
+
+// O_DIRECT needs aligned buffers
+static uchar *newChunk() {
+   void *p = 0;
+   if(posix_memalign(&p, 4096, readChunk)) return 0;
+   return (uchar *)p;
+}
+
+
+// read up to len bytes of the decoded data if d, else of the file
+static int fill(TDecompressor *d, int fd, uchar *buf, int len) {
+   if(d == 0) return readFull(fd, buf, len);
+   int n = 0;
+   while(n < len) {
+      int r = d->next(buf + n, len - n);
+      if(r < 0) return corruptData;
+      if(r == 0) break;
+      n += r;
+   }
+   return n;
+}
+
+
+// compare from current file positions up to eof using read(), or the
+// decoded data of d1/d2
+static int compareRead(int fd1, const char *fname1, int fd2, const char *fname2,
+		       TDecompressor *d1 = 0, TDecompressor *d2 = 0) {
+   uchar *buf1 = newChunk();
+   uchar *buf2 = newChunk();
+   int r = QC_SAME;
+   while(buf1 && buf2) {
+      int n1 = fill(d1, fd1, buf1, readChunk);
+      int n2 = fill(d2, fd2, buf2, readChunk);
+      if((n1 == corruptData) || (n2 == corruptData)) {
+	 r = corruptData;
+	 break;
+      }
+      if((n1 < 0) || (n2 < 0)) {
+	 userWarning("error while reading file '%s'!\n", n1<0?fname1:fname2);
+	 r = QC_TROUBLE;
+	 break;
+      }
+      if((n1 != n2) || memcmp(buf1, buf2, n1)) {
+	 r = QC_DIFFER;
+	 break;
+      }
+      if(n1 < readChunk) break; // eof
+   }
+   if(!(buf1 && buf2)) {
+      userWarning("out of memory while comparing '%s' and '%s'!\n", fname1, fname2);
+      r = QC_TROUBLE;
+   }
+   free(buf1);
+   free(buf2);
+   return r;
+}
+
+
+// compare two regular files of equal size chunk by chunk using mmap()
+static int compareMapped(int fd1, const char *fname1, int fd2, const char *fname2,
+			 off_t size) {
+   for(off_t off = 0; off < size; off += mapChunk) {
+      size_t len = (size - off) < mapChunk ? size_t(size - off) : size_t(mapChunk);
+      void *p1 = mmap(0, len, PROT_READ, MAP_SHARED, fd1, off);
+      void *p2 = (p1 == MAP_FAILED) ? MAP_FAILED : mmap(0, len, PROT_READ, MAP_SHARED, fd2, off);
+      if(p2 == MAP_FAILED) {
+	 // mmap not supported here: read the rest
+	 if(p1 != MAP_FAILED) munmap(p1, len);
+	 if((lseek(fd1, off, SEEK_SET) != off) || (lseek(fd2, off, SEEK_SET) != off)) {
+	    userWarning("error while seeking in file '%s' or '%s'!\n", fname1, fname2);
+	    return QC_TROUBLE;
+	 }
+	 return compareRead(fd1, fname1, fd2, fname2);
+      }
+      madvise(p1, len, MADV_SEQUENTIAL);
+      madvise(p2, len, MADV_SEQUENTIAL);
+      int d = memcmp(p1, p2, len);
+      munmap(p1, len);
+      munmap(p2, len);
+      if(d) return QC_DIFFER;
+   }
+   return QC_SAME;
+}
+
+
+// the decoded data of fname if it is compressed, read through a plain
+// descriptor of its own (fd), else 0
+static TDecompressor *openDecoded(const char *fname, int& fd) {
+   fd = TDecompressor::enabled ? open(fname, O_RDONLY) : -1;
+   TDecompressor *d = (fd >= 0) ? TDecompressor::open(fd, fname, false) : 0;
+   if((d == 0) && (fd >= 0)) close(fd);
+   return d;
+}
+
+
+// compare the decoded data if a file is compressed, as the diff does;
+// notCompressed if none is or the data turns out to be corrupt
+static int compareDecoded(int fd1, const char *fname1, int fd2, const char *fname2) {
+   int dfd1, dfd2;
+   TDecompressor *d1 = openDecoded(fname1, dfd1);
+   TDecompressor *d2 = openDecoded(fname2, dfd2);
+   int r = notCompressed;
+   if(d1 || d2) {
+      r = compareRead(fd1, fname1, fd2, fname2, d1, d2);
+      if(r == corruptData) {
+	 userWarning("%s: comparing the stored bytes\n", (d1 && *d1->error()) ? d1->error() : d2->error());
+	 if((lseek(fd1, 0, SEEK_SET) != 0) || (lseek(fd2, 0, SEEK_SET) != 0)) {
+	    userWarning("error while seeking in file '%s' or '%s'!\n", fname1, fname2);
+	    r = QC_TROUBLE;
+	 } else r = notCompressed;
+      }
+   }
+   if(d1) {
+      delete d1;
+      close(dfd1);
+   }
+   if(d2) {
+      delete d2;
+      close(dfd2);
+   }
+   return r;
+}
+
+
+int quickCompare(const char *fname1, const char *fname2) {
+   int fd1 = openRead(fname1);
+   if(fd1 < 0) {
+      userWarning("error while opening file '%s' for reading!\n", fname1);
+      return QC_TROUBLE;
+   }
+   int fd2 = openRead(fname2);
+   if(fd2 < 0) {
+      userWarning("error while opening file '%s' for reading!\n", fname2);
+      close(fd1);
+      return QC_TROUBLE;
+   }
+
+   int r;
+   struct stat s1, s2;
+   if(fstat(fd1, &s1) || fstat(fd2, &s2)) {
+      userWarning("can't stat '%s' or '%s'!\n", fname1, fname2);
+      r = QC_TROUBLE;
+   } else if(S_ISREG(s1.st_mode) && S_ISREG(s2.st_mode)) {
+      // regular files: identity and size decide without reading, unless
+      // they are compressed
+      if((s1.st_dev == s2.st_dev) && (s1.st_ino == s2.st_ino)) r = QC_SAME;
+      else if((r = compareDecoded(fd1, fname1, fd2, fname2)) != notCompressed) ;
+      else if(s1.st_size != s2.st_size) r = QC_DIFFER;
+      else if(TROTFile::io != TROTFile::IO_CACHED) r = compareRead(fd1, fname1, fd2, fname2);
+      else r = compareMapped(fd1, fname1, fd2, fname2, s1.st_size);
+   } else if(S_ISBLK(s1.st_mode) && S_ISBLK(s2.st_mode)) {
+      // raw disks or partitions: the same for their sizes
+      if(TROTFile::deviceSize(fd1) != TROTFile::deviceSize(fd2)) r = QC_DIFFER;
+      else if(s1.st_rdev == s2.st_rdev) r = QC_SAME;
+      else r = compareRead(fd1, fname1, fd2, fname2);
+   } else {
+      r = compareRead(fd1, fname1, fd2, fname2);
+   }
+
+   close(fd1);
+   close(fd2);
+   return r;
+}
@@ -0,0 +1,35 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tfilecmp_h_
+#define _tfilecmp_h_
+
+// exit status of quickCompare(), compatible to 'cmp -s'
+enum {QC_SAME = 0, QC_DIFFER = 1, QC_TROUBLE = 2};
+
+// check whether two files are identical, without diff engine and output:
+// sizes are compared first, then the contents block by block (mmap'ed
+// if possible), stopping at the first difference, read with O_DIRECT or
+// dropping the cache behind as TROTFile::io says; compressed files are
+// decoded on the fly, as for the diff (see TDecompressor)
+int quickCompare(const char *fname1, const char *fname2);
+
+#endif
@@ -0,0 +1,183 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#include "tiotune.h"
+#include "tminmax.h"
+
+
+static const long long MB = 1024*1024;
+
+
+// 1 for a rotational disk, 0 for an ssd, -1 if unknown (no block device)
+static int rotational(dev_t dev) {
+   char path[128];
+   snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/rotational", major(dev), minor(dev));
+   FILE *f = fopen(path, "r");
+   if(f == 0) return -1;
+   int r = -1;
+   if(fscanf(f, "%d", &r) != 1) r = -1;
+   fclose(f);
+   return r;
+}
+
+
+// the disk of a partition, else dev itself
+static dev_t wholeDisk(dev_t dev) {
+   char path[128];
+   snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/partition", major(dev), minor(dev));
+   if(access(path, F_OK)) return dev;
+   snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/../dev", major(dev), minor(dev));
+   FILE *f = fopen(path, "r");
+   if(f == 0) return dev;
+   unsigned int ma, mi;
+   if(fscanf(f, "%u:%u", &ma, &mi) == 2) dev = makedev(ma, mi);
+   fclose(f);
+   return dev;
+}
+
+
+// available memory in bytes
+static long long availableMemory() {
+   FILE *f = fopen("/proc/meminfo", "r");
+   if(f) {
+      char line[256];
+      long long kb;
+      while(fgets(line, sizeof(line), f)) 
+	if(sscanf(line, "MemAvailable: %lld kB", &kb) == 1) {
+	   fclose(f);
+	   return kb * 1024;
+	}
+      fclose(f);
+   }
+   return (long long)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+}
+
+
+// largest power of two <= n (at least 1)
+static int pow2Floor(long long n) {
+   int p = 1;
+   while(p * 2LL <= n) p *= 2;
+   return p;
+}
+
+
+TIOSetup tuneIO(const TAppConfig& ac) {
+   TIOSetup s;
+   s.readahead = 0;
+   
+   // the files
+   long long maxsize = 0;
+   long long total = 0;
+   bool dirs = false;
+   bool same = true;
+   int rot = -1;
+   dev_t dev0 = 0;
+   for(int i=0; i<int(ac.numParam()); i++) {
+      struct stat st;
+      if(stat(ac.param(i).data(), &st)) continue;
+      long long size = st.st_size;
+      dev_t dev = wholeDisk(st.st_dev);
+      if(S_ISBLK(st.st_mode)) {
+	 // raw disk or partition: the disk it is on
+	 int fd = open(ac.param(i).data(), O_RDONLY);
+	 if(fd >= 0) {
+	    size = tMax(0LL, TROTFile::deviceSize(fd));
+	    close(fd);
+	 }
+	 dev = wholeDisk(st.st_rdev);
+      }
+      if(S_ISDIR(st.st_mode)) dirs = true;
+      else {
+	 maxsize = tMax(maxsize, size);
+	 total += size;
+      }
+      if(i == 0) dev0 = dev;
+      else if(dev != dev0) same = false;
+      rot = tMax(rot, rotational(dev));
+   }
+   long long avail = availableMemory();
+   
+   // memory budget per file
+   long long budget = ac.getInt("buffer-memory") * MB;
+   if(budget == 0) budget = tMin(tMax(avail / 64, MB), 64*MB);
+   
+   // backend and buffer size
+   const char *why;
+   if(ac("large-files")) {
+      s.io = TROTFile::IO_CACHED;
+      s.bufsize = 4*MB;
+      if(!ac.getInt("buffer-memory")) budget = 16*MB;
+      why = "-O";
+   } else if(!dirs && (maxsize <= MB)) {
+      s.io = TROTFile::IO_CACHED;
+      s.bufsize = 64*1024;
+      budget = MB;
+      why = "small files";
+   } else if((rot == 1) && same) {
+      // one disk: large sequential reads of each file instead of seeks
+      s.io = TROTFile::IO_CACHED;
+      s.bufsize = 4*MB;
+      s.readahead = 16*MB;
+      why = "files share a rotational disk";
+   } else if(!dirs && (total > avail / 2)) {
+      // the files don't fit in the cache anyway
+      s.io = TROTFile::IO_DIRECT;
+      s.bufsize = (rot == 1) ? 4*MB : MB;
+      why = "files larger than half the available memory";
+   } else {
+      s.io = TROTFile::IO_MMAP;
+      s.bufsize = MB;
+      s.readahead = (rot == 1) ? 4*MB : 0;
+      why = (rot == 1) ? "files on different rotational disks" : "files on ssd or memory";
+   }
+   if(ac("direct-io")) {
+      s.io = TROTFile::IO_DIRECT;
+      s.bufsize = tMax(s.bufsize, int(MB));
+      why = "--direct-io";
+   }
+   if(ac("drop-cache")) {
+      s.io = TROTFile::IO_DROP;
+      why = "--drop-cache";
+   }
+   if(ac("watch") && (s.io == TROTFile::IO_MMAP)) {
+      // a watched file may shrink: reading its mapping past the new end is a SIGBUS
+      s.io = TROTFile::IO_CACHED;
+      why = "--watch";
+   }
+   
+   // buffer count: the budget, but not more than the largest file needs
+   s.numbuf = tMax(4, pow2Floor(budget / s.bufsize));
+   if(!dirs && maxsize) 
+     while((s.numbuf > 4) && ((s.numbuf / 2LL) * s.bufsize >= maxsize)) s.numbuf /= 2;
+   
+   char line[256];
+   snprintf(line, sizeof(line), "io: %s, %d x %dk buffers per file, readahead %dk (%s; %s disk, %s device, %lldMB available)", 
+	    TROTFile::ioName(s.io), s.numbuf, s.bufsize >> 10, s.readahead >> 10, why,
+	    rot < 0 ? "unknown" : rot ? "rotational" : "ssd", same ? "one" : "different", avail / MB);
+   s.reason = line;
+   return s;
+}
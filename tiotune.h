@@ -0,0 +1,44 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tiotune_h_
+#define _tiotune_h_
+
+#include "tappconfig.h"
+#include "trotfile.h"
+#include "tstring.h"
+
+// buffer setup for TROTFile, chosen from the sizes of the files, their 
+// devices (shared, rotational) and the memory budget
+struct TIOSetup {
+   TROTFile::IO_T io;
+   int numbuf;
+   int bufsize;
+   int readahead;   // see TROTFile::readahead
+   tstring reason;  // for --verbose
+};
+
+// pick the setup for the files (or directories) given on the command line,
+// -O, --direct-io, --drop-cache and --buffer-memory override the choice,
+// --watch never maps the files
+TIOSetup tuneIO(const TAppConfig& ac);
+
+#endif
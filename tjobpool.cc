@@ -0,0 +1,121 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "tjobpool.h"
+#include "tmap.h"
+#include "terror.h"
+
+
+TJobPool::TJobPool(size_t result_size):
+numjobs(0), resultsize((result_size + 7) & ~size_t(7)), results(0), 
+mapsize(0), status()
+{
+}
+
+
+TJobPool::~TJobPool() {
+   freeResults();
+}
+
+
+void TJobPool::freeResults() {
+   if(results) munmap(results, mapsize);
+   results = 0;
+   mapsize = 0;
+}
+
+
+int TJobPool::numCPUs() {
+   long n = sysconf(_SC_NPROCESSORS_ONLN);
+   return n > 0 ? int(n) : 1;
+}
+
+
+// sort job indices by size, largest first, so large jobs do not delay the end
+struct TLargerFirst {
+   TLargerFirst(const tvector<double>& s): sizes(s) {}
+   bool operator()(int a, int b) const {return sizes[a] > sizes[b];}
+   const tvector<double>& sizes;
+};
+
+tvector<int> TJobPool::largestFirst(const tvector<double>& sizes) {
+   tvector<int> order;
+   for(size_t i=0; i<sizes.size(); i++) order += int(i);
+   std::stable_sort(order.begin(), order.end(), TLargerFirst(sizes));
+   return order;
+}
+
+
+void TJobPool::run(int num_jobs, int maxjobs, const tvector<int>& order) {
+   tmap<pid_t,int> running; // pid -> job
+   size_t next = 0;
+   
+   // result slots in shared memory
+   freeResults();
+   numjobs = num_jobs;
+   status = tvector<int>(numjobs, -1);
+   mapsize = numjobs * resultsize;
+   if(mapsize == 0) mapsize = 1;
+   void *p = mmap(0, mapsize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+   if(p == MAP_FAILED) 
+     userError("can't allocate %lu bytes of shared memory!\n", (unsigned long)mapsize);
+   results = (char *)p;
+   memset(results, 0, mapsize);
+   
+   if(maxjobs < 1) maxjobs = 1;
+   while((next < order.size()) || !running.empty()) {
+      // start jobs
+      while((next < order.size()) && (int(running.size()) < maxjobs)) {
+	 int i = order[next++];
+	 fflush(stdout);
+	 fflush(stderr);
+	 pid_t pid = fork();
+	 if(pid < 0) userError("can't fork worker process for job %d!\n", i);
+	 if(pid == 0) {
+	    int r = job(i, result(i));
+	    fflush(stdout);
+	    fflush(stderr);
+	    _exit(r);
+	 }
+	 running[pid] = i;
+      }
+      
+      // wait for one job
+      if(running.empty()) continue;
+      int st;
+      pid_t pid = waitpid(-1, &st, 0);
+      if(pid < 0) fatalError("waitpid failed!\n");
+      if(running.find(pid) == running.end()) continue;
+      int i = running[pid];
+      running.erase(pid);
+      if(WIFEXITED(st)) status[i] = WEXITSTATUS(st);
+      else {
+	 userWarning("job %d killed by signal %d\n", i, WIFSIGNALED(st) ? WTERMSIG(st) : 0);
+	 status[i] = 2;
+      }
+   }
+}
@@ -0,0 +1,66 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tjobpool_h_
+#define _tjobpool_h_
+
+#include <sys/types.h>
+#include "tvector.h"
+
+// run jobs 0..numjobs-1 in forked worker processes, at most maxjobs at 
+// a time: all data set up before run() is shared with the workers, each
+// job reports back through a fixed size result slot in shared memory
+class TJobPool {
+ public:
+   // ctor & dtor
+   TJobPool(size_t result_size);
+   virtual ~TJobPool();
+   
+   // run jobs in the given order, return when all jobs are done
+   void run(int num_jobs, int maxjobs, const tvector<int>& order);
+   
+   // access
+   void *result(int i) const {return results + i * resultsize;}
+   int exitStatus(int i) const {return status[i];}
+   int numJobs() const {return numjobs;}
+   static int numCPUs();
+   static tvector<int> largestFirst(const tvector<double>& sizes);
+   
+ protected:
+   // called in the worker process, the return value is its exit status
+   virtual int job(int i, void *result) = 0;
+   
+ private:
+   int numjobs;
+   size_t resultsize;
+   char *results;    // shared memory
+   size_t mapsize;
+   tvector<int> status;
+   
+   // private methods
+   void freeResults();
+   
+   // forbid copy
+   TJobPool(const TJobPool&);
+   const TJobPool& operator=(const TJobPool&);
+};
+
+#endif
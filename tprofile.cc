@@ -0,0 +1,134 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+
+#include <time.h>
+#include <sys/time.h>
+#include "tprofile.h"
+#include "trotfile.h"
+#include "tjson.h"
+
+
+TProfile profile;
+
+static const char *className[TProfile::NUM_CLASSES] = {"match", "substitution", "deletion", "insertion"};
+
+
+double profileClock() {
+#ifdef CLOCK_MONOTONIC
+   struct timespec ts;
+   if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0) return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+   struct timeval tv;
+   gettimeofday(&tv, 0);
+   return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+TProfile::TProfile():
+syncs(0), compares(0), maxCompares(0), syncTime(0), matchTime(0), holeBytes(0), sharedBytes(0),
+outputMode("none"), outputTime(0)
+{
+   for(int c=0; c<NUM_CLASSES; c++) events[c] = bytes[c] = 0;
+}
+
+
+void TProfile::print(FILE *f, bool json, const TROTFile& f1, const TROTFile& f2) const {
+   const TROTFile *file[2] = {&f1, &f2};
+   int i, c;
+   if(json) {
+      fprintf(f, "{\n  \"files\": [");
+      for(i=0; i<2; i++) {
+	 fprintf(f, "%s\n    {\"name\": ", i?",":"");
+	 printJSONString(f, file[i]->name());
+	 fprintf(f, ", \"accesses\": %lld, \"misses\": %lld, \"bytes_read\": %lld, \"read_seconds\": %.6f}",
+		 file[i]->accesses, file[i]->misses, file[i]->bytesRead, file[i]->readTime);
+      }
+      fprintf(f, "\n  ],\n  \"engine\": {\"syncronize_calls\": %lld, \"compare_calls\": %lld, \"max_compares_per_sync\": %lld, \"sync_seconds\": %.6f, \"match_seconds\": %.6f, \"hole_bytes\": %lld, \"shared_bytes\": %lld},\n",
+	      syncs, compares, maxCompares, syncTime, matchTime, holeBytes, sharedBytes);
+      fprintf(f, "  \"output\": {\"mode\": \"%s\", \"seconds\": %.6f", outputMode, outputTime);
+      for(c=0; c<NUM_CLASSES; c++) 
+	fprintf(f, ", \"%s\": {\"events\": %lld, \"bytes\": %lld}", className[c], events[c], bytes[c]);
+      fprintf(f, "}\n}\n");
+      return;
+   }
+   
+   fprintf(f, "\nprofile:\n%-24s %14s %14s %14s %10s\n", "file", "accesses", "misses", "bytes read", "seconds");
+   for(i=0; i<2; i++)
+     fprintf(f, "%-24.24s %14lld %14lld %14lld %10.3f\n", file[i]->name(), 
+	     file[i]->accesses, file[i]->misses, file[i]->bytesRead, file[i]->readTime);
+   fprintf(f, "\n%-24s %14lld %14s %14s %10.3f\n", "syncronize() calls", syncs, "", "", syncTime);
+   fprintf(f, "%-24s %14lld %14s %14s\n", "compare() calls", compares, "", "");
+   fprintf(f, "%-24s %14.1f %14s %14s\n", "  per syncronize()", syncs ? double(compares) / syncs : 0.0, "", "");
+   fprintf(f, "%-24s %14lld %14s %14s\n", "  max per syncronize()", maxCompares, "", "");
+   fprintf(f, "%-24s %14s %14s %14s %10.3f\n", "match()", "", "", "", matchTime);
+   fprintf(f, "%-24s %14s %14s %14lld\n", "  bytes against holes", "", "", holeBytes);
+   fprintf(f, "%-24s %14s %14s %14lld\n", "  bytes in shared extents", "", "", sharedBytes);
+   fprintf(f, "\n%-24s %14s %14s %14s %10.3f\n", (tstring("output: ") + outputMode).data(), 
+	   "events", "bytes", "", outputTime);
+   for(c=0; c<NUM_CLASSES; c++)
+     fprintf(f, "  %-22s %14lld %14lld\n", className[c], events[c], bytes[c]);
+}
+
+
+// output sink wrapper
+
+void TDiffProfile::ins(int i) {
+   double t = profileClock();
+   s.ins(i);
+   profile.outputTime += profileClock() - t;
+   profile.events[TProfile::INS]++;
+   profile.bytes[TProfile::INS] += i;
+}
+
+
+void TDiffProfile::del(int i) {
+   double t = profileClock();
+   s.del(i);
+   profile.outputTime += profileClock() - t;
+   profile.events[TProfile::DEL]++;
+   profile.bytes[TProfile::DEL] += i;
+}
+
+
+void TDiffProfile::sub(int i, int ins, int del) {
+   double t = profileClock();
+   s.sub(i, ins, del);
+   profile.outputTime += profileClock() - t;
+   profile.events[TProfile::SUB]++;
+   profile.bytes[TProfile::SUB] += 2*i + ins + del;
+}
+
+
+void TDiffProfile::mat(int i) {
+   double t = profileClock();
+   s.mat(i);
+   profile.outputTime += profileClock() - t;
+   profile.events[TProfile::MAT]++;
+   profile.bytes[TProfile::MAT] += 2*i;
+}
+
+
+void TDiffProfile::flush() {
+   double t = profileClock();
+   s.flush();
+   profile.outputTime += profileClock() - t;
+}
@@ -0,0 +1,99 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+
+#ifndef _tprofile_h_
+#define _tprofile_h_
+
+#include <stdio.h>
+#include "tdiffsink.h"
+
+// counters and timers for --profile: build with -DQDIFF_NO_PROFILE to
+// compile them out, PROFILE(stmt) then expands to nothing
+#ifndef QDIFF_NO_PROFILE
+#define PROFILE(stmt) stmt
+#else
+#define PROFILE(stmt)
+#endif
+
+class TROTFile;
+
+// monotonic clock in seconds
+double profileClock();
+
+// engine and output counters of one diff
+class TProfile {
+ public:
+   TProfile();
+   
+   // engine
+   long long syncs;        // syncronize() calls
+   long long compares;     // compare() calls, one per diagonal searched
+   long long maxCompares;  // most compare() calls in one syncronize()
+   double syncTime;        // seconds in syncronize()
+   double matchTime;       // seconds in match()
+   long long holeBytes;    // bytes matched against a hole, see textents.h
+   long long sharedBytes;  // bytes matched from shared extents (reflinks)
+   
+   // output (counted by TDiffProfile)
+   enum CLASS_T {MAT, SUB, DEL, INS, NUM_CLASSES};
+   const char *outputMode;
+   long long events[NUM_CLASSES];
+   long long bytes[NUM_CLASSES]; // bytes of both files
+   double outputTime;      // seconds in the output sink
+   
+   // report
+   void print(FILE *f, bool json, const TROTFile& f1, const TROTFile& f2) const;
+   
+ private:
+   // forbid copy
+   TProfile(const TProfile&);   
+   const TProfile& operator= (const TProfile&);
+};
+
+extern TProfile profile;
+
+
+// sink which counts and times the edit script passed to another sink
+class TDiffProfile: public TDiffSink {
+ public:
+   TDiffProfile(TDiffSink& sink, const char *mode): s(sink) {profile.outputMode = mode;}
+   
+   // interface
+   void ins(int i);
+   void del(int i);
+   void sub(int i, int ins=0, int del=0);
+   void mat(int i);
+   
+   void flush();
+   void degraded(const char *how) {s.degraded(how);}
+   bool full() const {return s.full();}
+   void seek(int o1, int o2) {s.seek(o1, o2);}
+   
+ private:
+   TDiffSink& s;
+   
+   // forbid copy
+   TDiffProfile(const TDiffProfile&);   
+   const TDiffProfile& operator= (const TDiffProfile&);
+};
+
+#endif
@@ -21,12 +21,32 @@
 #include "trotfile.h"
 #include <sys/stat.h>
 #include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+
+TROTFile::IO_T TROTFile::io = TROTFile::IO_CACHED;
+int TROTFile::readahead = 0;
+bool TROTFile::hugePages = true;
+
+static const int assoc = 4;               // buffers per set
+static const int ioAlign = 4096;          // O_DIRECT buffer alignment
+static const int dropAhead = 4*1024*1024; // default readahead with IO_DROP
+static const size_t hugePage = 2*1024*1024; // x86-64/arm64 pmd size
 
 
 TROTFile::TROTFile(const char *filename, int num_buf, int buf_size)
-:numbuf(num_buf), bufsize(buf_size), bufbits(0), bufmask(0), nummask(0),
+:accesses(0), misses(0), bytesRead(0), readTime(0),
+numbuf(num_buf), bufsize(buf_size), bufbits(0), bufmask(0), waybits(0), setmask(0),
 offmask(0), off(new int[numbuf]), 
-buf(new uchar *[numbuf]), _size(0), fname(filename), file(0)
+buf(new uchar *[numbuf]), _size(0), fname(filename), file(0), fd(-1), map(0), dec(0), dev(0), regular(false), blockdev(false), align(ioAlign)
 {
    bool nonreg = false;
    
@@ -38,22 +58,55 @@ buf(new uchar *[numbuf]), _size(0), fname(filename), file(0)
    bufmask = bufsize-1;
    offmask = ~bufmask;
    bufbits = intLog2(bufsize);
-   nummask = numbuf-1;
+   initSets();
    
    // get file existance, type and _size
    struct stat a;
    if(stat(filename, &a)) 
      userError("file '%s' does not exist!\n", filename);
-   if(!S_ISREG(a.st_mode)) {
+   blockdev = S_ISBLK(a.st_mode);
+   if(!S_ISREG(a.st_mode) && !blockdev) {
       userWarning("'%s' is not a regular file\n", filename);
       nonreg = true;
    }
    _size = a.st_size;
+   dev = a.st_dev;
    
    // open file
    file = fopen(filename, "rb");
    if(file==0) 
      userError("error while opening file '%s' for reading!\n", filename);
+   fd = fileno(file);
+   
+   // block device: size and sector size from the driver
+   if(blockdev) {
+      int sector = 0;
+      long long size = deviceSize(fd, &sector);
+      if(size < 0) {
+	 userWarning("can't get the size of block device '%s'\n", filename);
+	 blockdev = false;
+	 nonreg = true;
+      } else if(size > 0x7fffffffLL) {
+	 userError("block device '%s' has %lld bytes, only devices up to 2GB can be compared!\n", filename, size);
+      } else {
+	 _size = int(size);
+	 align = tMax(ioAlign, sector);
+      }
+   }
+   
+   // compressed file: access the decoded data
+   if(!nonreg && !blockdev) {
+      dec = TDecompressor::open(fileno(file), filename);
+      if(dec) _size = dec->size();
+      else {
+	 // offsets are 32 bit in the engine and the output
+	 if(a.st_size > 0x7fffffffLL)
+	   userError("file '%s' has %lld bytes, only files up to 2GB can be compared!\n", 
+		     filename, (long long)a.st_size);
+	 regular = true;
+	 if(TExtentMap::enabled) extents.load(fileno(file), _size, TExtentMap::method);
+      }
+   }
 
    if(nonreg) {
       // get size of nonregular file
@@ -84,9 +137,29 @@ buf(new uchar *[numbuf]), _size(0), fname(filename), file(0)
 		  filename);     
    }
    
+   // cache neutral reading
+   if((regular || blockdev) && (io == IO_DIRECT) && (bufsize % align == 0)) {
+      int d = open(filename, O_RDONLY | O_DIRECT);
+      if(d >= 0) fd = d;
+      else userWarning("can't open '%s' with O_DIRECT, reading it through the cache\n", filename);
+   }
+   if((regular || blockdev) && (io == IO_DROP)) {
+      // drop the clean cached pages first: the data comes from the device
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+   }
+   
+   if((regular || blockdev) && (io == IO_MMAP) && (_size > 0)) {
+      void *p = mmap(0, _size, PROT_READ, MAP_SHARED, fd, 0);
+      if(p != MAP_FAILED) {
+	 map = (uchar *)p;
+	 adviseHuge(map, _size);
+      }
+   }
+   
    // alloc buffers
    for(int i=0; i<numbuf; i++) {
-      buf[i] = new uchar[bufsize];
+      buf[i] = map ? 0 : newBuf();
       off[i] = -1; // invalidate buffer
    }
    
@@ -94,10 +167,66 @@ buf(new uchar *[numbuf]), _size(0), fname(filename), file(0)
 }
 
 
+// a file replaced by a new one is opened again, buffers holding data at
+// from or later are dropped and a mapping is renewed
+void TROTFile::refresh(int from) {
+   struct stat a, b;
+   if(stat(fname.data(), &a)) 
+     userError("file '%s' does not exist!\n", fname.data());
+   if(a.st_size > 0x7fffffffLL)
+     userError("file '%s' grew beyond 2GB!\n", fname.data());
+   if(fstat(fileno(file), &b) || (a.st_ino != b.st_ino) || (a.st_dev != b.st_dev)) {
+      FILE *f = fopen(fname.data(), "rb");
+      if(f == 0) 
+	userError("error while opening file '%s' for reading!\n", fname.data());
+      if(fd != fileno(file)) {
+	 close(fd);
+	 fd = open(fname.data(), O_RDONLY | O_DIRECT);
+      } else fd = -1;
+      fclose(file);
+      file = f;
+      if(fd < 0) fd = fileno(file);
+      dev = a.st_dev;
+   }
+   
+   if(map) {
+      munmap(map, _size);
+      map = 0;
+      void *p = (a.st_size > 0) ? mmap(0, a.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+      if(p != MAP_FAILED) {
+	 map = (uchar *)p;
+	 adviseHuge(map, a.st_size);
+      }
+      for(int i=0; i<numbuf; i++) {
+	 buf[i] = map ? 0 : newBuf();
+	 off[i] = -1;
+      }
+   }
+   _size = a.st_size;
+   for(int i=0; i<numbuf; i++) 
+     if(off[i] + bufsize > from) off[i] = -1;
+   if(regular && (TExtentMap::enabled || mapped())) 
+     extents.load(fileno(file), _size, TExtentMap::method);
+}
+
+
+const char *TROTFile::ioName(IO_T io) {
+   switch(io) {
+    case IO_DIRECT: return "direct";
+    case IO_DROP:   return "drop-cache";
+    case IO_MMAP:   return "mmap";
+    default:        return "buffered";
+   }
+}
+
+
 TROTFile::~TROTFile() {
+   delete dec;
+   if(fd != fileno(file)) close(fd);
    fclose(file);
    for(int i=0; i<numbuf; i++) 
-     delete[] buf[i];
+     if(!map) free(buf[i]);
+   if(map) munmap(map, _size);
    delete[] off;
    delete[] buf;
 }
@@ -119,18 +248,136 @@ bool TROTFile::isPowerOf2(int i) const {
 }
 
 
+// read a buffer with pread() (and not fseek()+fread()), the file offset may 
+// be shared with forked processes, compressed files are decoded, holes
+// are not read at all and mapped files are not copied
 void TROTFile::loadBuf(int offset, int buffer) {
-   if(fseek(file, offset, SEEK_SET))
-     fatalError("LoadBuf: fseek failed!\n");
    int len = bufsize;
    if(offset==(_size&offmask)) len = _size & bufmask; 
-   int r = fread(buf[buffer], 1, len, file);
+   PROFILE(double t = profileClock());
+   int r = len;
+   bool hole = extents.holeLen(offset) >= len;
+   if(map) {
+      buf[buffer] = map + offset;
+      if(readahead) madvise(map + offset, tMin(readahead, _size - offset), MADV_WILLNEED);
+      hole = true; // nothing copied
+   }
+   else if(dec) dec->read(offset, buf[buffer], len);
+   else if(hole) memset(buf[buffer], 0, len);
+   else r = readBuf(offset, buf[buffer], len);
+   PROFILE(readTime += profileClock() - t; misses++; if(!hole) bytesRead += len);
    if(r != len)
-     fatalError("LoadBuf: fread failed!\n");
+     fatalError("LoadBuf: pread failed!\n");
    off[buffer] = offset;
 }
 
 
+bool TROTFile::shareExtents(TROTFile& f) {
+   if(!TExtentMap::reflinks || !regular || !f.regular || (dev != f.dev)) return false;
+   extents.load(fileno(file), _size, TExtentMap::FIEMAP);
+   f.extents.load(fileno(f.file), f._size, TExtentMap::FIEMAP);
+   return hasLocations() && f.hasLocations();
+}
+
+
+// numbuf buffers in sets of assoc (or fewer) buffers
+void TROTFile::initSets() {
+   int ways = tMin(numbuf, assoc);
+   waybits = intLog2(ways);
+   setmask = (numbuf >> waybits) - 1;
+}
+
+
+// bring the buffer at offset to the front of its set (first): a hit in
+// another buffer of the set only reorders them, a miss replaces the least
+// recently used one
+void TROTFile::fetch(int offset, int first) {
+   int last = first + (1 << waybits) - 1;
+   int w = first+1;
+   while((w <= last) && (off[w] != offset)) w++;
+   if(w > last) loadBuf(offset, w = last);
+   uchar *b = buf[w];
+   for(; w > first; w--) {
+      buf[w] = buf[w-1];
+      off[w] = off[w-1];
+   }
+   buf[first] = b;
+   off[first] = offset;
+}
+
+
+// buffers are aligned for O_DIRECT, buffers of huge page size or more to
+// huge pages so that they are backed by them completely
+uchar *TROTFile::newBuf() const {
+   void *p = 0;
+   bool huge = hugePages && (size_t(bufsize) >= hugePage);
+   if(posix_memalign(&p, huge ? hugePage : align, bufsize))
+     userError("out of memory for the buffers of '%s'!\n", fname.data());
+   if(huge) adviseHuge(p, bufsize);
+   return (uchar *)p;
+}
+
+
+long long TROTFile::deviceSize(int fd, int *sector) {
+   struct stat a;
+   if(fstat(fd, &a) || !S_ISBLK(a.st_mode)) return -1;
+#if defined(BLKGETSIZE64) && defined(BLKSSZGET)
+   unsigned long long size;
+   if(ioctl(fd, BLKGETSIZE64, &size)) return -1;
+   if(sector && ioctl(fd, BLKSSZGET, sector)) *sector = 512;
+   return (long long)size;
+#else
+   off_t size = lseek(fd, 0, SEEK_END);
+   lseek(fd, 0, SEEK_SET);
+   if(sector) *sector = 512;
+   return size;
+#endif
+}
+
+
+// only the huge pages completely inside the range, silently ignored if
+// the kernel has no transparent huge pages (or they are disabled)
+void TROTFile::adviseHuge(const void *p, size_t len) {
+#ifdef MADV_HUGEPAGE
+   if(!hugePages) return;
+   size_t a = (size_t(p) + hugePage - 1) & ~(hugePage - 1);
+   size_t e = (size_t(p) + len) & ~(hugePage - 1);
+   if(e > a) madvise((void *)a, e - a, MADV_HUGEPAGE);
+#endif
+}
+
+
+// read len bytes at offset (a multiple of bufsize): O_DIRECT reads the
+// whole (aligned) buffer, IO_DROP drops the pages just read, and the next
+// readahead bytes are hinted
+int TROTFile::readBuf(int offset, uchar *b, int len) {
+   if(fd != fileno(file)) {
+      int r = pread(fd, b, bufsize, offset);
+      if((r >= 0) || (errno != EINVAL)) return tMin(r, len);
+      userWarning("O_DIRECT read of '%s' refused, reading it through the cache\n", fname.data());
+      close(fd);
+      fd = fileno(file);
+   }
+   int r = pread(fd, b, len, offset);
+   bool hint = regular || blockdev;
+   if(hint && (io == IO_DROP)) {
+      posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+      posix_fadvise(fd, off_t(offset) + len, readahead ? readahead : dropAhead, POSIX_FADV_WILLNEED);
+   } else if(hint && readahead)
+     posix_fadvise(fd, off_t(offset) + len, readahead, POSIX_FADV_WILLNEED);
+   return r;
+}
+
+
+// read the whole file into the buffers if they are large enough, return 
+// whether the file is completely buffered now
+bool TROTFile::preload() {
+   if(double(numbuf) * bufsize < _size) return false;
+   for(int b=0; b<=(_size-1)/bufsize; b++) (*this)[b*bufsize];
+   return true;
+}
+
+
 
 
 
@@ -24,25 +24,78 @@
 #include "terror.h"
 #include "ttypes.h"
 #include "tstring.h"
+#include "tprofile.h"
+#include "tminmax.h"
+#include "tdecompress.h"
+#include "textents.h"
+#include <sys/types.h>
 
 class TROTFile {
  public:
+   // how buffers are read: through the page cache, with O_DIRECT, 
+   // through the cache dropping the pages behind (see --direct-io and
+   // --drop-cache) or not at all, pointing into a mapping of the file
+   enum IO_T {IO_CACHED, IO_DIRECT, IO_DROP, IO_MMAP};
+   static IO_T io;
+   static int readahead; // bytes hinted ahead of each read (0: kernel default)
+   static const char *ioName(IO_T io);
+   // back large buffers and mappings with transparent huge pages (see
+   // --no-huge-pages), adviseHuge() asks for them on [p, p+len)
+   static bool hugePages;
+   static void adviseHuge(const void *p, size_t len);
+   // size of the block device open as fd (and its logical sector size), 
+   // -1 if fd is no block device
+   static long long deviceSize(int fd, int *sector = 0);
+   
    // ctor & dtor
    TROTFile(const char *fname, int numbuf, int bufsize);
    ~TROTFile();
 
    // readonly access
    uchar operator[] (int i);
+   const uchar *span(int i, int len); // len bytes at i if in one buffer, else 0
+   int spanLen(int i) const {return tMin(bufsize - (i & bufmask), _size - i);}
    int size() const {return _size;}
    const char *name() const {return fname.data();};
+   bool preload();
+   int bufSize() const {return bufsize;}
+   int numBuf() const {return numbuf;}
+   const TDecompressor *decompressor() const {return dec;}
+   bool isRegular() const {return regular;}
+   // the file changed on disk from offset from on (see --watch)
+   void refresh(int from);
+   
+   // holes (read as zero without I/O), see textents.h
+   bool hasHoles() const {return extents.hasHoles();}
+   int holeLen(int i) const {return int(extents.holeLen(i));}
+   int dataLen(int i) const {return mapped() ? int(extents.dataLen(i)) : _size - i;}
+   
+   // reflink copies: load the device locations of the extents of both 
+   // files if they are on one filesystem, return whether they may share
+   bool shareExtents(TROTFile& f);
+   bool hasLocations() const {return extents.hasLocations();}
+   off_t location(int i, int& len) const {
+      off_t l = 0;
+      off_t p = extents.location(i, l);
+      len = int(l);
+      return p;
+   }
+   
+   // profiling counters, see tprofile.h
+   long long accesses;  // operator[] calls
+   long long misses;    // buffers loaded
+   long long bytesRead; // bytes read from file (decoded bytes if compressed)
+   double readTime;     // seconds in pread() and decoding
    
  private:
-   // internal buffer
+   // internal buffer: a set associative cache, the buffers of a set are
+   // kept in LRU order (most recently used first)
    int numbuf;   // number of buffer
    int bufsize;  // size of buffer
    int bufbits;  // bits of buffer size
    int bufmask;  // address mask for buffer (in)
-   int nummask;  // address mask for buffer (which)
+   int waybits;  // bits of the number of buffers per set
+   int setmask;  // address mask for set (which)
    int offmask;  // address mask for offset
    int *off;     // offset of buffer
    uchar **buf;  // buffer
@@ -51,11 +104,24 @@ class TROTFile {
    int _size;    // size of file
    tstring fname; // filename
    FILE *file;   // open file
+   int fd;       // file descriptor for reading buffers (O_DIRECT)
+   uchar *map;   // whole file mapped with IO_MMAP, the buffers point into it
+   TDecompressor *dec; // decoded view of a compressed file, else 0
+   TExtentMap extents; // data extents of a sparse file or reflink copy
+   dev_t dev;    // filesystem
+   bool regular; // plain regular file (not compressed)
+   bool blockdev; // raw disk or partition
+   int align;    // buffer alignment for O_DIRECT: page or logical sector
    
    // private methods
    void loadBuf(int offset, int buffer);
+   void fetch(int offset, int first);
+   void initSets();
+   int readBuf(int offset, uchar *b, int len);
+   uchar *newBuf() const;
    int intLog2(int i) const;
    bool isPowerOf2(int i) const;
+   bool mapped() const {return extents.hasHoles() || extents.hasLocations();}
    
    // forbid copy
    TROTFile(const TROTFile& a);
@@ -64,15 +130,24 @@ class TROTFile {
 
 inline uchar TROTFile::operator[] (int i) {
    if(((uint)i) < ((uint)_size)) {
+      PROFILE(accesses++);
       int offset = i&offmask;
-      int buffer = (i >> bufbits) & nummask;
-      if(offset!=off[buffer]) loadBuf(offset, buffer);
-      return buf[buffer][i & bufmask];
+      int first = ((i >> bufbits) & setmask) << waybits;
+      if(offset!=off[first]) fetch(offset, first);
+      return buf[first][i & bufmask];
    } else 
      fatalError("operator[]: index out of range! (%d not in [0..%d])\n", 
 		i, _size-1);
 }
 
+// the span is valid until the next access to this file, i+len must be 
+// inside the file
+inline const uchar *TROTFile::span(int i, int len) {
+   if((i & offmask) != ((i+len-1) & offmask)) return 0;
+   (*this)[i];
+   return buf[((i >> bufbits) & setmask) << waybits] + (i & bufmask);
+}
+
 #endif
 
 
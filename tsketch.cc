@@ -0,0 +1,175 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <stdio.h>
+#include <string.h>
+#include <set>
+#include "tsketch.h"
+#include "tminmax.h"
+
+typedef unsigned long long u64;
+
+static const char sketchMagic[8] = {'Q','D','I','F','F','S','K','1'};
+static const u64 hashBase = 0x100000001b3ULL; // rolling hash multiplier
+
+
+// final mix of the rolling hash (from murmurhash3), so the hash values
+// are uniformly distributed as needed for minhash
+static inline u64 mix(u64 h) {
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+   return h;
+}
+
+
+TSketch::TSketch(int shingle_len, int sketch_size):
+shingle(shingle_len), k(sketch_size), filesize(0), mins()
+{
+   if(shingle < 1) fatalError("shingle length must be >0! (was %d)\n", shingle);
+   if(k < 1) fatalError("sketch size must be >0! (was %d)\n", k);
+}
+
+
+void TSketch::compute(TROTFile& f, bool progress) {
+   int size = f.size();
+   int print = progress ? 1024*1024 : -1;
+   int pri = print;
+   u64 h = 0;
+   u64 out = 1; // hashBase^shingle
+   std::set<u64> s;
+   
+   for(int i=0; i<shingle; i++) out *= hashBase;
+   filesize = size;
+   for(int i=0; i<size; i++, pri--) {
+      // roll: add byte i, remove byte i-shingle
+      h = h * hashBase + f[i] + 1;
+      if(i >= shingle) h -= out * (f[i-shingle] + 1);
+      if(i >= shingle-1) {
+	 u64 v = mix(h);
+	 if((int(s.size()) < k) || (v < *s.rbegin())) {
+	    if(s.insert(v).second && (int(s.size()) > k)) s.erase(--s.end());
+	 }
+      }
+      if(pri == 0) {
+	 pri = print;
+	 fprintf(stderr, "sketch(%5dK)  \r", i>>10);
+	 fflush(stderr);
+      }
+   }
+   mins.clear();
+   for(std::set<u64>::const_iterator it = s.begin(); it != s.end(); ++it)
+     mins += *it;
+}
+
+
+double TSketch::jaccard(const TSketch& b) const {
+   if(shingle != b.shingle)
+     userError("sketches use different shingle lengths (%d and %d)!\n", shingle, b.shingle);
+   
+   // the n smallest values of the union are a sample of the union,
+   // count how many of them are in both sets
+   int n = tMin(k, b.k);
+   int i = 0, j = 0, taken = 0, both = 0;
+   while((taken < n) && ((i < int(mins.size())) || (j < int(b.mins.size())))) {
+      if(j == int(b.mins.size()) || ((i < int(mins.size())) && (mins[i] < b.mins[j]))) i++;
+      else if(i == int(mins.size()) || (b.mins[j] < mins[i])) j++;
+      else {
+	 i++;
+	 j++;
+	 both++;
+      }
+      taken++;
+   }
+   if(taken == 0) return 1.0; // both empty
+   return double(both) / double(taken);
+}
+
+
+double TSketch::distinct() const {
+   if(int(mins.size()) < k) return mins.size(); // exact
+   return double(k - 1) / (double(mins[k-1]) / 18446744073709551616.0);
+}
+
+
+static void putU64(FILE *f, u64 v) {
+   for(int i=0; i<8; i++, v >>= 8) fputc(int(v & 0xff), f);
+}
+
+static bool getU64(FILE *f, u64& v) {
+   v = 0;
+   for(int i=0; i<8; i++) {
+      int c = fgetc(f);
+      if(c == EOF) return false;
+      v |= u64(c) << (8*i);
+   }
+   return true;
+}
+
+
+// file format: magic, shingle, k, file size, number of values, values
+// (all numbers 64 bit little endian)
+void TSketch::save(const char *fname) const {
+   FILE *f = fopen(fname, "wb");
+   if(f == 0) userError("can't open '%s' for writing!\n", fname);
+   fwrite(sketchMagic, 1, sizeof(sketchMagic), f);
+   putU64(f, shingle);
+   putU64(f, k);
+   putU64(f, u64(filesize));
+   putU64(f, mins.size());
+   for(size_t i=0; i<mins.size(); i++) putU64(f, mins[i]);
+   if(fclose(f)) userError("error while writing sketch '%s'!\n", fname);
+}
+
+
+void TSketch::load(const char *fname) {
+   FILE *f = fopen(fname, "rb");
+   if(f == 0) userError("error while opening file '%s' for reading!\n", fname);
+   char magic[sizeof(sketchMagic)];
+   u64 sh, kk, fs, n, v;
+   if((fread(magic, 1, sizeof(magic), f) != sizeof(magic)) || 
+      memcmp(magic, sketchMagic, sizeof(magic)) ||
+      !getU64(f, sh) || !getU64(f, kk) || !getU64(f, fs) || !getU64(f, n) ||
+      (sh < 1) || (kk < 1) || (n > kk))
+     userError("'%s' is not a valid sketch file!\n", fname);
+   shingle = int(sh);
+   k = int(kk);
+   filesize = double(fs);
+   mins.clear();
+   for(u64 i=0; i<n; i++) {
+      if(!getU64(f, v)) userError("sketch file '%s' is truncated!\n", fname);
+      mins += v;
+   }
+   fclose(f);
+}
+
+
+bool TSketch::isSketchFile(const char *fname) {
+   FILE *f = fopen(fname, "rb");
+   if(f == 0) return false;
+   char magic[sizeof(sketchMagic)];
+   bool r = (fread(magic, 1, sizeof(magic), f) == sizeof(magic)) && 
+     (memcmp(magic, sketchMagic, sizeof(magic)) == 0);
+   fclose(f);
+   return r;
+}
@@ -0,0 +1,56 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _tsketch_h_
+#define _tsketch_h_
+
+#include "trotfile.h"
+#include "tvector.h"
+
+// bottom-k minhash sketch over all shingles (substrings of a fixed length)
+// of a file: estimates jaccard similarity of the shingle sets of two files
+class TSketch {
+ public:
+   // ctor & dtor
+   TSketch(int shingle_len = 20, int sketch_size = 256);
+   ~TSketch() {}
+   
+   // create
+   void compute(TROTFile& f, bool progress);
+   void load(const char *fname);
+   void save(const char *fname) const;
+   static bool isSketchFile(const char *fname);
+   
+   // readonly access
+   double jaccard(const TSketch& b) const;
+   double distinct() const;    // estimated number of distinct shingles
+   int shingleLen() const {return shingle;}
+   int sketchSize() const {return k;}
+   double fileSize() const {return filesize;}
+   
+ private:
+   int shingle;     // shingle length in bytes
+   int k;           // max number of hash values kept
+   double filesize; // size of sketched file
+   tvector<unsigned long long> mins; // k smallest hashes, ascending
+};
+
+#endif
@@ -0,0 +1,303 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "twatch.h"
+#include "terror.h"
+#include "tminmax.h"
+
+typedef unsigned long long u64;
+
+static const int watchBlock = 64*1024;   // bytes per block hash
+static const int snapSpacing = 64*1024;  // initial bytes between snapshots
+static const int maxSnapshots = 1024;    // then every second one is dropped
+static const int appendSamples = 8;      // blocks checked after an append
+static const int debounceMs = 200;       // no change for this long: diff
+
+
+// open for hashing, with O_DIRECT in TROTFile::IO_DIRECT mode if possible
+static int openHashed(const char *fname) {
+   if(TROTFile::io == TROTFile::IO_DIRECT) {
+      int fd = open(fname, O_RDONLY | O_DIRECT);
+      if(fd >= 0) return fd;
+   }
+   return open(fname, O_RDONLY);
+}
+
+
+// O_DIRECT needs aligned buffers
+static uchar *newBlock() {
+   void *p = 0;
+   if(posix_memalign(&p, 4096, watchBlock)) return 0;
+   return (uchar *)p;
+}
+
+
+// fnv-1a over the 64 bit words of [from, to) of the open file fd, from a
+// multiple of watchBlock on (whole blocks are read for O_DIRECT), with 
+// TROTFile::IO_DROP the pages read are dropped from the cache
+static u64 hashRange(int fd, off_t from, off_t to, uchar *buf) {
+   u64 h = 0xcbf29ce484222325ULL;
+   while(from < to) {
+      int n = pread(fd, buf, watchBlock, from);
+      if(n <= 0) return ~h; // gone: differs
+      if(TROTFile::io == TROTFile::IO_DROP) posix_fadvise(fd, from, n, POSIX_FADV_DONTNEED);
+      n = int(tMin(off_t(n), to - from));
+      int i = 0;
+      for(; i + 8 <= n; i += 8) {
+	 u64 w;
+	 memcpy(&w, buf + i, 8);
+	 h = (h ^ w) * 0x100000001b3ULL;
+      }
+      for(; i < n; i++) h = (h ^ buf[i]) * 0x100000001b3ULL;
+      from += n;
+   }
+   return h;
+}
+
+
+TWatch::TWatch(TROTFile& f1, TROTFile& f2, TDiffSink& sink, const TAppConfig& config):
+out(sink), ac(config), interval(config.getInt("watch-interval")), inotify(-1),
+spacing(snapSpacing)
+{
+   f[0] = &f1;
+   f[1] = &f2;
+   for(int k=0; k<2; k++)
+     if(!f[k]->isRegular())
+       userError("'%s' is not an uncompressed regular file, --watch needs two of them!\n", f[k]->name());
+   snapshot(last, 0, 0);
+   snaps += last;
+#ifdef __linux__
+   inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+   addWatches();
+   for(int k=0; k<2; k++) {
+      stated(k, fs[k]);
+      fs[k].size = f[k]->size();
+      hashFrom(k, 0);
+   }
+}
+
+
+TWatch::~TWatch() {
+   if(inotify >= 0) close(inotify);
+}
+
+
+void TWatch::snapshot(TSnapshot& s, int o1, int o2) const {
+   s.o1 = o1;
+   s.o2 = o2;
+   s.state = TSinkState();
+   if(!out.saveState(s.state))
+     userError("--watch does not work with this output.\n");
+}
+
+
+// keep the latest point and one every spacing bytes, thinned out to at
+// most maxSnapshots by doubling the spacing
+void TWatch::point(int o1, int o2) {
+   snapshot(last, o1, o2);
+   const TSnapshot& b = snaps.back();
+   if((o1 - b.o1) + (o2 - b.o2) < spacing) return;
+   snaps += last;
+   if(int(snaps.size()) > maxSnapshots) {
+      size_t n = 0;
+      for(size_t i=0; i<snaps.size(); i+=2) snaps[n++] = snaps[i];
+      snaps.resize(n);
+      spacing *= 2;
+   }
+}
+
+
+int TWatch::run() {
+   diff(*f[0], *f[1], out, ac, this);
+   for(;;) {
+      wait();
+
+      // first changed byte of each file and the latest point before both
+      int m[2];
+      for(int k=0; k<2; k++) {
+	 m[k] = tMin(firstChange(k), f[k]->size());
+	 f[k]->refresh(m[k]);
+	 // the hashes cover what the diff sees, the file may grow meanwhile
+	 fs[k].size = f[k]->size();
+	 hashFrom(k, m[k]);
+      }
+      if((last.o1 > m[0]) || (last.o2 > m[1])) {
+	 size_t i = snaps.size() - 1;
+	 while((i > 0) && ((snaps[i].o1 > m[0]) || (snaps[i].o2 > m[1]))) i--;
+	 snaps.resize(i + 1);
+	 last = snaps[i];
+      }
+
+      fprintf(stderr, "watch: files changed, diff continues at 0x%08X (%10d) : (%10d) 0x%08X\n",
+	      last.o1, last.o1, last.o2, last.o2);
+      TSinkState st = last.state;
+      out.loadState(st);
+      start1 = last.o1;
+      start2 = last.o2;
+      diff(*f[0], *f[1], out, ac, this);
+   }
+   return 0;
+}
+
+
+void TWatch::addWatches() {
+#ifdef __linux__
+   if(inotify < 0) return;
+   for(int k=0; k<2; k++)
+     inotify_add_watch(inotify, f[k]->name(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+		       IN_MOVE_SELF | IN_DELETE_SELF);
+#endif
+}
+
+
+bool TWatch::sameState(const TFileState& a, const TFileState& b) {
+   return (a.size == b.size) && (a.ino == b.ino) && (a.mtime == b.mtime) && 
+     (a.mtime_ns == b.mtime_ns);
+}
+
+
+// wait for a change of size, inode or mtime: woken by inotify, but the
+// files are also checked every interval seconds (replaced files, network
+// filesystems, no inotify); then wait until the files stay unchanged for
+// debounceMs (at most interval seconds), so a writer's burst of events
+// leads to one diff
+void TWatch::wait() {
+   fflush(stdout);
+   for(;;) {
+#ifdef __linux__
+      if(inotify >= 0) {
+	 struct pollfd p;
+	 p.fd = inotify;
+	 p.events = POLLIN;
+	 p.revents = 0;
+	 if(poll(&p, 1, interval * 1000) > 0) {
+	    char ev[4096];
+	    while(read(inotify, ev, sizeof(ev)) > 0) ;
+	 }
+      } else
+#endif
+	sleep(interval);
+      bool changed = false;
+      for(int k=0; k<2; k++) {
+	 TFileState s;
+	 if(stated(k, s) && !sameState(s, fs[k])) changed = true;
+      }
+      if(changed) break;
+   }
+   TFileState before[2];
+   for(int k=0; k<2; k++) stated(k, before[k]);
+   for(int ms = 0; ms < interval * 1000; ms += debounceMs) {
+      usleep(debounceMs * 1000);
+      bool settled = true;
+      for(int k=0; k<2; k++) {
+	 TFileState now;
+	 if(stated(k, now) && !sameState(now, before[k])) {
+	    settled = false;
+	    before[k] = now;
+	 }
+      }
+      if(settled) break;
+   }
+#ifdef __linux__
+   if(inotify >= 0) {
+      char ev[4096];
+      while(read(inotify, ev, sizeof(ev)) > 0) ;
+   }
+#endif
+   addWatches();
+}
+
+
+bool TWatch::stated(int k, TFileState& s) const {
+   struct stat a;
+   if(stat(f[k]->name(), &a)) return false;
+   s.size = a.st_size;
+   s.ino = a.st_ino;
+   s.mtime = a.st_mtime;
+   s.mtime_ns = a.st_mtim.tv_nsec;
+   return true;
+}
+
+
+// offset of the first byte of file k that differs from the last diff (the
+// old size if it was appended to), takes the new state but the hashes;
+// a file that only grew (same inode) is taken as appended to if its last
+// old block and a few samples before it are unchanged
+int TWatch::firstChange(int k) {
+   TFileState s;
+   if(!stated(k, s)) return 0;
+   if(sameState(s, fs[k])) return int(s.size);
+   off_t first = tMin(s.size, fs[k].size);
+   int fd = openHashed(f[k]->name());
+   uchar *buf = newBlock();
+   if((fd < 0) || (buf == 0)) {
+      if(fd >= 0) close(fd);
+      free(buf);
+      return 0;
+   }
+   size_t nb = fs[k].hash.size();
+   bool appended = (s.ino == fs[k].ino) && (s.size > fs[k].size);
+   for(int i = appendSamples - 1; appended && (i >= 0) && nb; i--) {
+      size_t b = (i == appendSamples - 1) ? nb - 1 : i * nb / appendSamples;
+      off_t from = off_t(b) * watchBlock;
+      if(hashRange(fd, from, tMin(from + off_t(watchBlock), fs[k].size), buf) != fs[k].hash[b])
+	appended = false;
+   }
+   for(size_t b=0; (b < nb) && !appended; b++) {
+      off_t from = off_t(b) * watchBlock;
+      off_t to = tMin(from + off_t(watchBlock), fs[k].size);
+      if((to > s.size) || (hashRange(fd, from, to, buf) != fs[k].hash[b])) {
+	 first = tMin(first, from);
+	 break;
+      }
+   }
+   free(buf);
+   close(fd);
+   s.hash = fs[k].hash;
+   fs[k] = s;
+   return int(tMin(first, off_t(0x7fffffff)));
+}
+
+
+// hash the blocks of file k from the block of offset from on
+void TWatch::hashFrom(int k, off_t from) {
+   size_t b = from / watchBlock;
+   fs[k].hash.resize(tMin(b, fs[k].hash.size()));
+   int fd = openHashed(f[k]->name());
+   uchar *buf = newBlock();
+   if((fd >= 0) && buf)
+     for(off_t o = off_t(fs[k].hash.size()) * watchBlock; o < fs[k].size; o += watchBlock)
+       fs[k].hash += hashRange(fd, o, tMin(o + off_t(watchBlock), fs[k].size), buf);
+   free(buf);
+   if(fd >= 0) close(fd);
+}
@@ -0,0 +1,84 @@
+/*GPL*START*
+ * 
+ * Copyright (C) 1998 by Johannes Overmann <overmann@iname.com>
+ * Copyright (C) 2008 by Tong Sun <suntong001@users.sourceforge.net>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * *GPL*END*/  
+
+
+#ifndef _twatch_h_
+#define _twatch_h_
+
+#include <sys/types.h>
+#include "trotfile.h"
+#include "tdiffsink.h"
+#include "tdiffengine.h"
+#include "tappconfig.h"
+#include "tvector.h"
+
+// --watch: diff the files, then wait for changes (inotify, else polling)
+// and continue the diff from the last point before the first changed or
+// appended byte, printing only the events from there on; the files and
+// their buffers stay open
+class TWatch: public TDiffPoints {
+ public:
+   TWatch(TROTFile& f1, TROTFile& f2, TDiffSink& out, const TAppConfig& ac);
+   ~TWatch();
+
+   // diff and watch until killed
+   int run();
+   void point(int o1, int o2);
+
+ private:
+   // a point of the diff with the sink state there
+   struct TSnapshot {
+      int o1;
+      int o2;
+      TSinkState state;
+   };
+   // what the file looked like at the last diff
+   struct TFileState {
+      off_t size;
+      ino_t ino;
+      time_t mtime;
+      long mtime_ns;
+      tvector<unsigned long long> hash; // per block of watchBlock bytes
+   };
+
+   TROTFile *f[2];
+   TDiffSink& out;
+   const TAppConfig& ac;
+   int interval;               // seconds between polls
+   int inotify;                // inotify fd or -1
+   tvector<TSnapshot> snaps;   // points at least spacing bytes apart
+   TSnapshot last;             // latest point
+   int spacing;
+   TFileState fs[2];
+
+   void snapshot(TSnapshot& s, int o1, int o2) const;
+   void addWatches();
+   void wait();
+   bool stated(int k, TFileState& s) const;
+   static bool sameState(const TFileState& a, const TFileState& b);
+   int firstChange(int k);
+   void hashFrom(int k, off_t from);
+
+   // forbid copy
+   TWatch(const TWatch&);
+   const TWatch& operator=(const TWatch&);
+};
+
+#endif